@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "fylee/http/http_server.h"
+#include "fylee/address.h"
+#include "fylee/buffer.h"
+#include "fylee/eventloop.h"
+#include "fylee/thread.h"
+
+// 向 StreamServlet 上传分块编码的大请求体, 每次写入都在分块大小行的中间截断,
+// 使服务端每次 read 都停在半行; 检查输入缓冲占用的内存块不随上传量增长.
+// 客户端在服务端落后 kWindow 字节时等待, 避免一次读到整个接收缓冲区
+// 用法: chunked_upload_test [请求体MB数]
+
+using namespace fylee;
+using namespace fylee::http;
+
+static const int kPort = 8093;
+static const size_t kChunkSize = 1000;
+// 每次写入包含的分块数
+static const size_t kChunksPerWrite = 4;
+// 客户端最多领先服务端的请求体字节数
+static const size_t kWindow = 64 * 1024;
+// 输入缓冲允许占用的上限, 远小于请求体
+static const size_t kMaxOutstanding = 1024 * 1024;
+
+class CountServlet : public StreamServlet {
+public:
+    CountServlet(EventLoop* loop)
+        :StreamServlet("count")
+        ,loop_(loop) {}
+
+    void onBody(HttpRequest::ptr request, const char* data, size_t len) override {
+        received += len;
+        maxOutstanding = std::max(maxOutstanding,
+                loop_->getBufferPoolStats().outstandingBytes);
+    }
+
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response
+                   ,HttpSession::ptr session) override {
+        response->setBody(std::to_string(received.load()));
+        return 0;
+    }
+
+    std::atomic<size_t> received{0};
+    uint64_t maxOutstanding = 0;
+private:
+    EventLoop* loop_;
+};
+
+static bool WriteAll(int fd, const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if(n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void RunClient(EventLoop* loop, CountServlet* servlet, size_t bodySize, bool* ok) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        ::close(fd);
+        loop->quit();
+        return;
+    }
+
+    std::string req = "POST /upload HTTP/1.1\r\nHost: localhost\r\n"
+                      "Transfer-Encoding: chunked\r\n\r\n";
+    char line[32];
+    std::string chunk(kChunkSize, 'x');
+    // 写入的切分点, 都落在分块大小行的第一个字节之后; 同时记下切分点之前的请求体长度
+    std::vector<std::pair<size_t, size_t> > cuts;
+    for(size_t sent = 0, n = 0; sent < bodySize; sent += kChunkSize, ++n) {
+        if(n % kChunksPerWrite == 0) {
+            cuts.push_back(std::make_pair(req.size() + 1, sent));
+        }
+        snprintf(line, sizeof(line), "%zx\r\n", kChunkSize);
+        req += line;
+        req += chunk;
+        req += "\r\n";
+    }
+    req += "0\r\n\r\n";
+    cuts.push_back(std::make_pair(req.size(), bodySize));
+
+    *ok = true;
+    size_t off = 0;
+    for(size_t i = 0; *ok && i < cuts.size(); ++i) {
+        while(servlet->received + kWindow < cuts[i].second) {
+            usleep(50);
+        }
+        *ok = WriteAll(fd, req.data() + off, cuts[i].first - off);
+        off = cuts[i].first;
+    }
+
+    char rsp[4096];
+    ssize_t n = *ok ? ::read(fd, rsp, sizeof(rsp) - 1) : -1;
+    if(n <= 0 || strncmp(rsp, "HTTP/1.1 200", 12) != 0) {
+        *ok = false;
+    }
+    ::close(fd);
+    loop->quit();
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? atoi(argv[1]) : 8;
+    size_t bodySize = mb * 1024 * 1024 / kChunkSize * kChunkSize;
+
+    EventLoop loop;
+    Address::ptr addr = IPv4Address::Create("127.0.0.1", kPort);
+    HttpServer::ptr server(new HttpServer(&loop, addr, false, 0));
+    std::shared_ptr<CountServlet> servlet = std::make_shared<CountServlet>(&loop);
+    server->getServletDispatch()->addServlet("/upload", servlet);
+    server->start();
+
+    bool ok = false;
+    Thread client(std::bind(&RunClient, &loop, servlet.get(), bodySize, &ok), "client");
+    client.start();
+    loop.loop();
+    client.join();
+
+    printf("body=%zu received=%zu max_outstanding=%lu\n", bodySize,
+           servlet->received.load(), (unsigned long)servlet->maxOutstanding);
+    if(!ok || servlet->received != bodySize
+            || servlet->maxOutstanding > kMaxOutstanding) {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
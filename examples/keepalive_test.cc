@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+#include "fylee/http/http_server.h"
+#include "fylee/address.h"
+#include "fylee/eventloop.h"
+#include "fylee/thread.h"
+
+// 长连接上流水线发送多个请求, 其中有空消息体和 204 的响应;
+// 每个响应都要能按 content-length 找到结尾, 否则客户端会一直等下去
+
+using namespace fylee;
+using namespace fylee::http;
+
+static const int kPort = 8094;
+
+struct Expect {
+    const char* path;
+    int status;
+    const char* body;
+};
+
+static const Expect s_expects[] = {
+    {"/empty", 200, ""},
+    {"/nocontent", 204, ""},
+    {"/hello", 200, "hello"},
+    {"/empty", 200, ""},
+};
+static const size_t s_count = sizeof(s_expects) / sizeof(s_expects[0]);
+
+/**
+ * @brief 从 data 开头取一个响应, 返回它的长度, 不完整或缺少长度信息时返回 0
+ */
+static size_t ParseResponse(const std::string& data, int& status, std::string& body) {
+    size_t end = data.find("\r\n\r\n");
+    if(end == std::string::npos || data.compare(0, 9, "HTTP/1.1 ") != 0) {
+        return 0;
+    }
+    status = atoi(data.c_str() + 9);
+    long length = -1;
+    size_t pos = data.find("\r\n");
+    while(pos < end) {
+        size_t next = data.find("\r\n", pos + 2);
+        std::string line = data.substr(pos + 2, next - pos - 2);
+        if(strncasecmp(line.c_str(), "content-length:", 15) == 0) {
+            length = atol(line.c_str() + 15);
+        }
+        pos = next;
+    }
+    if(length < 0) {
+        if(status != 204) {
+            return 0;
+        }
+        length = 0;
+    }
+    if(data.size() < end + 4 + length) {
+        return 0;
+    }
+    body = data.substr(end + 4, length);
+    return end + 4 + length;
+}
+
+static void RunClient(EventLoop* loop, bool* ok) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // 响应无法定界时等到超时
+    timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if(::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        ::close(fd);
+        loop->quit();
+        return;
+    }
+
+    std::string req;
+    for(size_t i = 0; i < s_count; ++i) {
+        req += std::string("GET ") + s_expects[i].path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    }
+    *ok = ::write(fd, req.data(), req.size()) == (ssize_t)req.size();
+
+    std::string data;
+    size_t done = 0;
+    char buf[4096];
+    while(*ok && done < s_count) {
+        int status = 0;
+        std::string body;
+        size_t n = ParseResponse(data, status, body);
+        if(n > 0) {
+            if(status != s_expects[done].status || body != s_expects[done].body) {
+                printf("response %zu: status=%d body=%s\n", done, status, body.c_str());
+                *ok = false;
+            }
+            data.erase(0, n);
+            ++done;
+            continue;
+        }
+        ssize_t rt = ::read(fd, buf, sizeof(buf));
+        if(rt <= 0) {
+            printf("response %zu not delimited, pending=%zu\n", done, data.size());
+            *ok = false;
+            break;
+        }
+        data.append(buf, rt);
+    }
+    ::close(fd);
+    loop->quit();
+}
+
+int main(int argc, char** argv) {
+    EventLoop loop;
+    Address::ptr addr = IPv4Address::Create("127.0.0.1", kPort);
+    HttpServer::ptr server(new HttpServer(&loop, addr, true, 0));
+    auto dispatch = server->getServletDispatch();
+    dispatch->addServlet("/empty", [](HttpRequest::ptr req, HttpResponse::ptr rsp
+                                     ,HttpSession::ptr session) {
+        return 0;
+    });
+    dispatch->addServlet("/nocontent", [](HttpRequest::ptr req, HttpResponse::ptr rsp
+                                         ,HttpSession::ptr session) {
+        rsp->setStatus(HttpStatus::NO_CONTENT);
+        return 0;
+    });
+    dispatch->addServlet("/hello", [](HttpRequest::ptr req, HttpResponse::ptr rsp
+                                     ,HttpSession::ptr session) {
+        rsp->setBody("hello");
+        return 0;
+    });
+    server->start();
+
+    bool ok = false;
+    Thread client(std::bind(&RunClient, &loop, &ok), "client");
+    client.start();
+    loop.loop();
+    client.join();
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -6,7 +6,7 @@ fylee::Logger::ptr g_logger = LOG_ROOT();
 
 void run(fylee::EventLoop* loop) {
     auto addr = fylee::Address::LookupAnyIPAddress("0.0.0.0:8080");
-    fylee::http::HttpServer::ptr server(new fylee::http::HttpServer(loop, addr, false, 1));
+    fylee::http::HttpServer::ptr server(new fylee::http::HttpServer(loop, addr, true, 1));
     server->start();
     loop->loop();
 }
@@ -9,32 +9,110 @@
 namespace fylee {
 
 static fylee::Logger::ptr g_logger = LOG_NAME("system");
+static thread_local BufferPool* t_bufferPool = nullptr;
 
-Buffer::Node::Node(size_t s)
-    :ptr(new char[s]), 
-     next(nullptr), 
-     size(s) {
+// 池中一整块内存的大小: 节点头加数据
+static const size_t s_pool_block_size = sizeof(Buffer::Node) + BufferPool::kNodeSize;
+
+BufferPool::BufferPool(size_t maxFree)
+    :maxFree_(maxFree)
+    ,hits_(0)
+    ,misses_(0)
+    ,freeNodes_(0)
+    ,refs_(1) {
+}
+
+BufferPool::~BufferPool() {
+    shrink();
+}
+
+BufferPool* BufferPool::GetThis() {
+    return t_bufferPool;
+}
+
+void BufferPool::SetThis(BufferPool* pool) {
+    t_bufferPool = pool;
 }
 
-Buffer::Node::Node()
-    :ptr(nullptr)
-    ,next(nullptr)
-    ,size(0) {
+void* BufferPool::allocate() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    if(free_.empty()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(s_pool_block_size);
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    void* block = free_.back();
+    free_.pop_back();
+    freeNodes_.store(free_.size(), std::memory_order_relaxed);
+    return block;
 }
 
-Buffer::Node::~Node() {
-    if(ptr) {
-        delete[] ptr;
+void BufferPool::release(void* block) {
+    // 当前线程的池是它, 说明在池所在线程且 EventLoop 还持有引用, 计数不会归零
+    if(t_bufferPool == this && free_.size() < maxFree_) {
+        free_.push_back(block);
+        freeNodes_.store(free_.size(), std::memory_order_relaxed);
+        refs_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    ::operator delete(block);
+    unref();
+}
+
+void BufferPool::shrink() {
+    for(auto& i : free_) {
+        ::operator delete(i);
+    }
+    std::vector<void*>().swap(free_);
+    freeNodes_.store(0, std::memory_order_relaxed);
+}
+
+void BufferPool::destroy() {
+    shrink();
+    unref();
+}
+
+void BufferPool::unref() {
+    if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+BufferPoolStats BufferPool::getStats() const {
+    BufferPoolStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.freeNodes = freeNodes_.load(std::memory_order_relaxed);
+    stats.outstandingBytes = (refs_.load(std::memory_order_relaxed) - 1) * kNodeSize;
+    return stats;
+}
+
+Buffer::Node* Buffer::Node::Create(size_t s) {
+    BufferPool* pool = s == BufferPool::kNodeSize ? t_bufferPool : nullptr;
+    void* block = pool ? pool->allocate() : ::operator new(sizeof(Node) + s);
+    Node* node = static_cast<Node*>(block);
+    node->ptr = reinterpret_cast<char*>(node + 1);
+    node->next = nullptr;
+    node->size = s;
+    node->pool = pool;
+    return node;
+}
+
+void Buffer::Node::Destroy(Node* node) {
+    if(node->pool) {
+        node->pool->release(node);
+    } else {
+        ::operator delete(node);
     }
 }
 
 Buffer::Buffer(size_t base_size)
     :baseSize_(base_size)
     ,position_(0)
-    ,capacity_(base_size)
+    ,capacity_(0)
     ,size_(0)
-    ,root_(new Node(base_size))
-    ,curr_(root_) {
+    ,root_(nullptr)
+    ,curr_(nullptr) {
 }
 
 Buffer::~Buffer() {
@@ -42,21 +120,37 @@ Buffer::~Buffer() {
     while(tmp) {
         curr_ = tmp;
         tmp = tmp->next;
-        delete curr_;
+        Node::Destroy(curr_);
     }
 }
 
 void Buffer::clear() {
     position_ = size_ = 0;
-    capacity_ = baseSize_;
-    Node* tmp = root_->next;
+    capacity_ = 0;
+    Node* tmp = root_;
     while(tmp) {
         curr_ = tmp;
         tmp = tmp->next;
-        delete curr_;
+        Node::Destroy(curr_);
     }
-    curr_ = root_;
-    root_->next = NULL;
+    root_ = curr_ = nullptr;
+}
+
+void Buffer::discardRead() {
+    size_t count = position_ / baseSize_;
+    if(count == 0) {
+        return;
+    }
+    // curr_ 指向 position_ 所在的块(或为空), 不受影响
+    for(size_t i = 0; i < count; ++i) {
+        Node* tmp = root_;
+        root_ = root_->next;
+        Node::Destroy(tmp);
+    }
+    size_t bytes = count * baseSize_;
+    position_ -= bytes;
+    size_ -= bytes;
+    capacity_ -= bytes;
 }
 
 void Buffer::write(const void* buf, size_t size) {
@@ -98,6 +192,9 @@ void Buffer::read(void* buf, size_t size) {
     if(size > getReadSize()) {
         throw std::out_of_range("not enough len");
     }
+    if(size == 0) {
+        return;
+    }
 
     size_t npos = position_ % baseSize_;
     size_t ncap = curr_->size - npos;
@@ -127,11 +224,19 @@ void Buffer::read(void* buf, size_t size, size_t position) const { // 从指定
     if(size > (size_ - position)) {
         throw std::out_of_range("not enough len");
     }
+    if(size == 0) {
+        return;
+    }
 
     size_t npos = position % baseSize_;
-    size_t ncap = curr_->size - npos;
+    size_t count = position / baseSize_;
+    Node* cur = root_;
+    while(count > 0) {
+        cur = cur->next;
+        --count;
+    }
+    size_t ncap = cur->size - npos;
     size_t bpos = 0;
-    Node* cur = curr_;
     while(size > 0) {
         if(ncap >= size) {
             memcpy((char*)buf + bpos, cur->ptr + npos, size);
@@ -162,6 +267,9 @@ void Buffer::setPosition(size_t v) {
         size_ = position_;
     }
     curr_ = root_;
+    if(!curr_) {
+        return;
+    }
     while(v > curr_->size) {
         v -= curr_->size;
         curr_ = curr_->next;
@@ -225,17 +333,22 @@ void Buffer::addCapacity(size_t size) {
     size = size - old_cap;
     size_t count = ceil(1.0 * size / baseSize_); // 需要增加的内存块数量
     Node* tmp = root_;
-    while(tmp->next) {
+    while(tmp && tmp->next) {
         tmp = tmp->next;
     }
 
     Node* first = NULL;
     for(size_t i = 0; i < count; ++i) {
-        tmp->next = new Node(baseSize_);
+        Node* node = Node::Create(baseSize_);
+        if(tmp) {
+            tmp->next = node;
+        } else {
+            root_ = node;
+        }
         if(first == NULL) {
-            first = tmp->next;
+            first = node;
         }
-        tmp = tmp->next;
+        tmp = node;
         capacity_ += baseSize_;
     }
 
@@ -270,6 +383,26 @@ std::string Buffer::toHexString() const {
 }
 
 
+int64_t Buffer::find(char c, size_t len) const {
+    len = len > getReadSize() ? getReadSize() : len;
+    size_t npos = position_ % baseSize_;
+    size_t offset = 0;
+    Node* cur = curr_;
+    while(offset < len) {
+        size_t n = cur->size - npos;
+        n = n > len - offset ? len - offset : n;
+        const char* begin = cur->ptr + npos;
+        const char* p = static_cast<const char*>(memchr(begin, c, n));
+        if(p) {
+            return offset + (p - begin);
+        }
+        offset += n;
+        cur = cur->next;
+        npos = 0;
+    }
+    return -1;
+}
+
 uint64_t Buffer::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const {
     len = len > getReadSize() ? getReadSize() : len;
     if(len == 0) {
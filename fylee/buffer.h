@@ -7,28 +7,120 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <vector>
+#include <atomic>
+#include "noncopyable.h"
 
 namespace fylee {
 
+/**
+ * @brief BufferPool 的统计, 可在任意线程读取
+ */
+struct BufferPoolStats {
+    /// 从空闲链表取到节点的次数
+    uint64_t hits = 0;
+    /// 空闲链表为空、新分配节点的次数
+    uint64_t misses = 0;
+    /// 空闲链表中的节点数
+    uint64_t freeNodes = 0;
+    /// 从本池取出、尚未释放的节点字节数
+    uint64_t outstandingBytes = 0;
+};
+
+/**
+ * @brief Buffer 节点的内存池, 每个 EventLoop 一个
+ * @details EventLoop 构造时把它设为所在线程的当前池, 该线程中大小为 kNodeSize 的节点
+ *          (节点头和数据在同一块内存中)整块从空闲链表取. 节点记住来源的池, 释放时池仍是
+ *          当前线程的池(即在来源线程且 EventLoop 未析构)才放回空闲链表, 否则直接释放.
+ *          池的引用计数为未归还的节点数加上 EventLoop 持有的一个, 最后一个释放者负责 delete,
+ *          节点在 EventLoop 析构后、其它线程中释放也是安全的. 其它大小的节点不经过池
+ */
+class BufferPool : Noncopyable {
+public:
+    /// 池中节点的数据大小, 即 Buffer 默认的 base_size
+    static const size_t kNodeSize = 4096;
+
+    BufferPool(size_t maxFree);
+
+    /**
+     * @brief 当前线程的池, 没有 EventLoop 的线程返回 nullptr
+     */
+    static BufferPool* GetThis();
+
+    static void SetThis(BufferPool* pool);
+
+    /**
+     * @brief 取一块能放下 Buffer::Node 和 kNodeSize 字节数据的内存, 需在池所在线程调用
+     */
+    void* allocate();
+
+    /**
+     * @brief 归还 allocate 取出的内存, 可在任意线程调用
+     */
+    void release(void* block);
+
+    /**
+     * @brief 释放所有空闲节点, 需在池所在线程调用
+     */
+    void shrink();
+
+    /**
+     * @brief EventLoop 析构时代替 delete 调用, 需先 SetThis(nullptr)
+     * @details 释放空闲节点并放弃 EventLoop 的引用, 没有未归还的节点时立即 delete
+     */
+    void destroy();
+
+    BufferPoolStats getStats() const;
+private:
+    ~BufferPool();
+    /// 放弃一个引用, 最后一个时 delete
+    void unref();
+private:
+    size_t maxFree_;
+    std::vector<void*> free_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> freeNodes_;
+    /// 未归还的节点数, 加上 EventLoop 持有的 1
+    std::atomic<uint64_t> refs_;
+};
+
+/**
+ * @brief 由固定大小内存块组成的链式缓冲区
+ * @details 内存块在第一次写入时才分配, clear() 释放全部内存块(包括第一块),
+ *          空闲的连接不占用缓冲区内存. 默认大小的内存块来自当前线程的 BufferPool
+ */
 class Buffer {
 public:
     typedef std::shared_ptr<Buffer> ptr;
 
+    /// 节点头, 数据紧跟在节点头之后
     struct Node {
-        Node(size_t s);
-        Node();
-        ~Node();
+        /// 创建数据大小为 s 的节点, kNodeSize 大小的取自当前线程的 BufferPool
+        static Node* Create(size_t s);
+        static void Destroy(Node* node);
         char* ptr;
         Node* next;
         size_t size;
+        /// 节点来源的池, 不经过池时为空
+        BufferPool* pool;
     };
 
-    Buffer(size_t base_size = 4096);
+    Buffer(size_t base_size = BufferPool::kNodeSize);
 
     ~Buffer();
 
+    /**
+     * @brief 清空数据并释放所有内存块
+     */
     void clear();
 
+    /**
+     * @brief 释放当前位置之前已经读完的整块内存, 位置、大小和容量随之前移
+     * @details 未读数据一直不为空时(如流水线请求、分块上传读到半行), 已消费的内存块
+     *          不会被 clear 回收, 需定期调用以限制缓冲区大小. 之前取得的绝对位置随之失效
+     */
+    void discardRead();
+
     void write(const void* buf, size_t size);
 
     void read(void* buf, size_t size);
@@ -53,6 +145,12 @@ public:
     
     std::string toHexString() const;
 
+    /**
+     * @brief 在当前位置之后的 len 字节内查找字符 c, 不拷贝数据
+     * @return 相对当前位置的偏移, 没找到返回 -1
+     */
+    int64_t find(char c, size_t len) const;
+
     uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len = ~0ull) const;
 
     uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const;
@@ -74,7 +172,7 @@ private:
     size_t capacity_;
     /// 当前数据的大小
     size_t size_;
-    /// 第一个内存块指针(头节点)
+    /// 第一个内存块指针(头节点), 没有分配时为 nullptr
     Node* root_;
     /// 当前操作的内存块指针
     Node* curr_;
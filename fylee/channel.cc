@@ -10,7 +10,10 @@ Channel::Channel(EventLoop* loop, int fd)
      events_(0),
      revents_(0),
      index_(-1),
+     registeredEvents_(0),
+     pendingIndex_(-1),
      logHup_(true),
+     completionRecv_(false),
      tied_(false),
      eventHandling_(false),
      addedToLoop_(false) { }
@@ -32,6 +32,7 @@ public:
     int getFd() const { return fd_; }
     int getEvents() const { return events_; }
     void setRevents(int revt) { revents_ = revt; } 
+    int getRevents() const { return revents_; }
   
     bool isNoneEvent() const { return events_ == kNoneEvent; }
 
@@ -42,10 +43,23 @@ public:
     void disableAll() { events_ = kNoneEvent; update(); }
     bool isWriting() const { return events_ & EPOLLOUT; }
     bool isReading() const { return events_ & EPOLLIN; }
+    /**
+     * @brief 完成模式接收: 读事件由 Poller 直接收取数据代替, 需在 enableReading 之前设置
+     * @details 只有 UringPoller 支持, 数据通过 EventLoop::takeReceived 取出
+     */
+    void setCompletionRecv(bool v) { completionRecv_ = v; }
+    bool isCompletionRecv() const { return completionRecv_; }
 
     // for Poller
     int getIndex() { return index_; }
     void setIndex(int idx) { index_ = idx; }
+    /// 已经通过 epoll_ctl 交给内核的事件
+    int getRegisteredEvents() const { return registeredEvents_; }
+    void setRegisteredEvents(int events) { registeredEvents_ = events; }
+    /// 在 Poller 待提交列表中的下标, 不在列表中时为 -1
+    bool isUpdatePending() const { return pendingIndex_ >= 0; }
+    int getPendingIndex() const { return pendingIndex_; }
+    void setPendingIndex(int idx) { pendingIndex_ = idx; }
 
     // for debug
     std::string reventsToString() const;
@@ -72,7 +86,10 @@ public:
     int        events_;
     int        revents_; 
     int        index_; 
+    int        registeredEvents_;
+    int        pendingIndex_;
     bool       logHup_;
+    bool       completionRecv_;
 
     std::weak_ptr<void> tie_;
     bool tied_;
@@ -2,10 +2,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
 #include "connection.h"
 #include "tcp_server.h"
 #include "log.h"
 #include "weakcb.h"
+#include "util.h"
 #include "macro.h"
 #include "eventloop.h"
 #include "eventloopthreadpool.h"
@@ -27,6 +31,8 @@ Connection::Connection(EventLoop* loop,
     socket_(socket),
     stream_(stream),
     state_(kConnecting),
+    reading_(true),
+    completionRecv_(false),
     channel_(new Channel(loop, socket_->getSocket())),
     highWaterMark_(64 * 1024 * 1024), 
     inputBuffer_(new Buffer), 
@@ -48,8 +54,13 @@ Connection::~Connection() {
 }
 
 void Connection::send(const void* data, int len) {
-    std::string msg(static_cast<const char*>(data), len);
-    send(msg);
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendInLoop(data, len);
+        } else {
+            send(std::string(static_cast<const char*>(data), len));
+        }
+    }
 }
 
 void Connection::send(const std::string& message) {
@@ -57,20 +68,30 @@ void Connection::send(const std::string& message) {
         if (loop_->isInLoopThread()) {
             sendInLoop(message);
         } else {
+            send(std::string(message));
+        }
+    }
+}
+
+void Connection::send(std::string&& message) {
+    if (state_ == kConnected) {
+        if (loop_->isInLoopThread()) {
+            sendInLoop(message);
+        } else {
+            // bind 对象放得进 Task 内部缓冲区, 跨线程投递只有 message 本身的内存
             void (Connection::*fp)(const std::string& message) = &Connection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, shared_from_this(), message));
+            loop_->queueInLoop(std::bind(fp, shared_from_this(), std::move(message)));
         }
     }
 }
 
 void Connection::send(Buffer::ptr buf) {
-    std::string msg = buf->toString();
     if (state_ == kConnected) {
         if (loop_->isInLoopThread()) {
-            sendInLoop(msg);
+            sendInLoop(buf);
         } else {
-            void (Connection::*fp)(const std::string& message) = &Connection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, shared_from_this(), msg));
+            void (Connection::*fp)(Buffer::ptr buf) = &Connection::sendInLoop;
+            loop_->queueInLoop(std::bind(fp, shared_from_this(), std::move(buf)));
         }
     }
 }
@@ -115,11 +136,82 @@ void Connection::sendInLoop(const void* data, size_t len) {
             && highWaterMarkCallback_) {
             loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
-        outputBuffer_->write(static_cast<const char*>(data) + nwrote, remaining);
+        appendOutput(static_cast<const char*>(data) + nwrote, remaining);
+        channel_->enableWriting();
+    }
+}
+
+void Connection::sendInLoop(Buffer::ptr buf) {
+    loop_->assertInLoopThread();
+    bool faultError = false;
+    if (state_ == kDisconnected) {
+        LOG_WARN(g_logger) << "disconnected, give up writing";
+        return;
+    }
+
+    if (!channel_->isWriting() && outputBuffer_->getReadSize() == 0) {
+        if (writeBuffer(buf) < 0 && errno != EWOULDBLOCK) {
+            LOG_ERROR(g_logger) << "Connection::sendInLoop";
+            if (errno == EPIPE || errno == ECONNRESET)  {
+                faultError = true;
+            }
+        }
+        if (buf->getReadSize() == 0 && writeCompleteCallback_) { // 一次发完
+            loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+    }
+
+    size_t remaining = buf->getReadSize();
+    if (!faultError && remaining > 0) { // 继续写完剩下部分
+        size_t oldLen = outputBuffer_->getReadSize();
+        if (oldLen + remaining >= highWaterMark_
+            && oldLen < highWaterMark_
+            && highWaterMarkCallback_) {
+            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        }
+        if (oldLen == 0) {
+            // 输出缓冲为空时直接接管 buf 的节点链, 剩余部分无需再拷贝
+            outputBuffer_ = buf;
+        } else {
+            std::vector<iovec> iovs;
+            buf->getReadBuffers(iovs, remaining);
+            for (auto& iov : iovs) {
+                appendOutput(iov.iov_base, iov.iov_len);
+            }
+        }
         channel_->enableWriting();
     }
 }
 
+void Connection::appendOutput(const void* data, size_t len) {
+    // outputBuffer_ 按 FIFO 使用: position 为已发送位置, 新数据追加到末尾
+    size_t pos = outputBuffer_->getPosition();
+    outputBuffer_->setPosition(outputBuffer_->getSize());
+    outputBuffer_->write(data, len);
+    outputBuffer_->setPosition(pos);
+}
+
+ssize_t Connection::writeBuffer(Buffer::ptr buf) {
+    // 单次 writev 最多 IOV_MAX 个 iovec, 首个节点可能只剩一部分, 故少算一个
+    const size_t maxLen = (IOV_MAX - 1) * buf->getBaseSize();
+    ssize_t total = 0;
+    while (buf->getReadSize() > 0) {
+        size_t len = std::min(buf->getReadSize(), maxLen);
+        int n = stream_->write(buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return total > 0 ? total : -1;
+        }
+        total += n;
+        if (static_cast<size_t>(n) < len) {
+            break;
+        }
+    }
+    return total;
+}
+
 void Connection::shutdown() {
     if (state_ == kConnected) {
         setState(kDisconnecting);
@@ -182,6 +274,27 @@ void Connection::startReadInLoop() {
     if (!reading_ || !channel_->isReading()) {
         channel_->enableReading();
         reading_ = true;
+        // 暂停期间留在输入缓冲中的数据不会再产生读事件, 需要重新交给上层
+        if (inputBuffer_->getReadSize() > 0) {
+            loop_->queueInLoop(std::bind(&Connection::handleBufferedInput, shared_from_this()));
+        }
+    }
+}
+
+void Connection::handleBufferedInput() {
+    loop_->assertInLoopThread();
+    if (state_ == kConnected && reading_ && inputBuffer_->getReadSize() > 0) {
+        messageCallback_(shared_from_this(), loop_->now());
+        compactInput();
+    }
+}
+
+void Connection::compactInput() {
+    if (inputBuffer_->getReadSize() == 0) {
+        inputBuffer_->clear();
+    } else {
+        // 还剩半个请求或半行时, 已消费的内存块也要还回去, 否则缓冲区只增不减
+        inputBuffer_->discardRead();
     }
 }
 
@@ -194,6 +307,7 @@ void Connection::stopReadInLoop() {
     if (channel_->isReading()) {
         channel_->disableReading();
     }
+    reading_ = false;
 }
 
 void Connection::connectEstablished() {
@@ -201,6 +315,10 @@ void Connection::connectEstablished() {
     ASSERT(state_ == kConnecting);
     setState(kConnected);
     channel_->tie(shared_from_this());
+    if (completionRecv_ && !loop_->setupCompletionRecv()) {
+        completionRecv_ = false;
+    }
+    channel_->setCompletionRecv(completionRecv_);
     channel_->enableReading();
     connectionCallback_(shared_from_this());
 }
@@ -220,30 +338,75 @@ bool Connection::isReading() const {
 
 void Connection::handleRead(uint64_t receiveTime) {
     loop_->assertInLoopThread();
-    messageCallback_(shared_from_this(), receiveTime);
-    channel_->enableReading();
+    // 边沿触发, 必须把socket读空; 新数据追加在未读数据之后.
+    // 完成模式下数据已由 Poller 收好, 取空即可
+    size_t readPos = inputBuffer_->getPosition();
+    inputBuffer_->setPosition(inputBuffer_->getSize());
+    size_t chunk = inputBuffer_->getBaseSize();
+    size_t total = 0;
+    bool eof = false;
+    bool faultError = false;
+    while(true) {
+        int n = completionRecv_ ? loop_->takeReceived(channel_.get(), inputBuffer_)
+                                : stream_->read(inputBuffer_, chunk);
+        if(n > 0) {
+            total += n;
+            if(!completionRecv_ && (size_t)n < chunk) {
+                break;
+            }
+        } else if(n == 0) {
+            eof = true;
+            break;
+        } else {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR(g_logger) << "Connection::handleRead [" << name_
+                    << "] errno=" << errno << " errstr=" << strerror(errno);
+                faultError = true;
+            }
+            break;
+        }
+    }
+    inputBuffer_->setPosition(readPos);
+
+    // 暂停读取时(完成模式下在途的数据)只放入输入缓冲, 恢复时再交给上层
+    if(total > 0 && reading_) {
+        messageCallback_(shared_from_this(), receiveTime);
+    }
+    // 已消费的内存块还给 loop 的 BufferPool, 没读到数据时也释放为读取预留的内存块
+    compactInput();
+    if(eof || faultError) {
+        if(state_ == kConnected || state_ == kDisconnecting) {
+            handleClose();
+        }
+        return;
+    }
+    if (reading_) {
+        channel_->enableReading();
+    }
 }
 
 void Connection::handleWrite() {
     loop_->assertInLoopThread();
     if (channel_->isWriting()) {
-        int rt = stream_->write(outputBuffer_, outputBuffer_->getReadSize());
-        if (rt > 0) {
-            std::shared_ptr<char> buffer(new char[rt], 
-                                        [](char* ptr) { delete[] ptr; });
-            outputBuffer_->read(buffer.get(), rt);
-            if (outputBuffer_->getReadSize() == 0) {
-                channel_->disableWriting();
-                if (writeCompleteCallback_) {
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting) {
-                    shutdownInLoop();
-                }
+        ssize_t rt = writeBuffer(outputBuffer_);
+        if (outputBuffer_->getReadSize() == 0) {
+            outputBuffer_->clear();
+            channel_->disableWriting();
+            if (writeCompleteCallback_) {
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this()));
             }
-        } else {
-            LOG_ERROR(g_logger)<< "TcpConnection::handleWrite";
+            if (state_ == kDisconnecting) {
+                shutdownInLoop();
+            }
+        } else if (rt >= 0) {
+            outputBuffer_->discardRead();
+        } else if (errno != EWOULDBLOCK) {
+            LOG_ERROR(g_logger) << "Connection::handleWrite errno=" << errno
+                << " errstr=" << strerror(errno);
         }
     } else {
         LOG_INFO(g_logger) << "Connection fd = " << channel_->getFd()
@@ -258,8 +421,10 @@ void Connection::handleClose() {
     // we don't close fd, leave it to dtor, so we can find leaks easily.
     setState(kDisconnected);
     channel_->disableAll();
+    Connection::ptr guardThis(shared_from_this());
+    connectionCallback_(guardThis);
     // must be the last line
-    closeCallback_(shared_from_this());
+    closeCallback_(guardThis);
 }
 
 void Connection::handleError() {
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <string>
 #include <stdint.h>
+#include <sys/types.h>
 #include <functional>
 #include "mutex.h"
 #include "noncopyable.h"
@@ -42,7 +43,15 @@ public:
    
     void send(const void* message, int len);
     void send(const std::string& message);
-    void send(std::shared_ptr<Buffer> message);  
+    /**
+     * @brief 跨线程发送时直接把 message 移入投递的任务, 不再拷贝
+     */
+    void send(std::string&& message);
+    /**
+     * @brief 发送 message 中 [position, size) 的数据
+     * @details 不做拷贝, 调用后 message 归 Connection 所有, 调用方不能再修改它
+     */
+    void send(std::shared_ptr<Buffer> message);
     void shutdown(); 
     void forceClose();
     void forceCloseWithDelay(uint64_t seconds);
@@ -52,6 +61,14 @@ public:
 
     bool isReading() const;
 
+    /**
+     * @brief 使用完成模式接收, 需在 connectEstablished 之前调用
+     * @details 由 io_uring multishot recv 从 loop 的缓冲区环收取数据, 空闲连接不占接收缓冲;
+     *          loop 的 Poller 不支持时退回就绪通知加 read
+     */
+    void setCompletionRecv(bool v) { completionRecv_ = v; }
+    bool isCompletionRecv() const { return completionRecv_; }
+
     void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
 
     void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
@@ -80,6 +97,11 @@ private:
     void handleError();
     void sendInLoop(const std::string& message);
     void sendInLoop(const void* message, size_t len);
+    void sendInLoop(std::shared_ptr<Buffer> buf);
+    /// 将数据追加到 outputBuffer_ 末尾, 不改变已发送位置
+    void appendOutput(const void* data, size_t len);
+    /// 尽量写出 buf 中的可读数据, 返回写出的字节数, 出错且未写出任何数据时返回 -1
+    ssize_t writeBuffer(std::shared_ptr<Buffer> buf);
     void shutdownInLoop();
 
     void forceCloseInLoop();
@@ -87,6 +109,10 @@ private:
     const char* stateToString() const;
     void startReadInLoop();
     void stopReadInLoop();
+    /// 恢复读取后处理暂停期间留在输入缓冲中的数据
+    void handleBufferedInput();
+    /// 消息回调之后释放输入缓冲中已消费的内存块
+    void compactInput();
    
     EventLoop* loop_;
     const std::string name_;
@@ -94,6 +120,7 @@ private:
     std::shared_ptr<SocketStream> stream_;
     std::atomic<StateE> state_; 
     bool reading_;
+    bool completionRecv_;
     std::unique_ptr<Channel> channel_;
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
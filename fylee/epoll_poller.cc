@@ -0,0 +1,78 @@
+#include "epoll_poller.h"
+#include "macro.h"
+#include "channel.h"
+#include "log.h"
+#include <strings.h>
+
+namespace fylee {
+static fylee::Logger::ptr g_logger = LOG_NAME("system");
+
+template<typename To, typename From>
+inline To implicit_cast(From const &f) {
+    return f;
+}
+
+EPollPoller::EPollPoller(EventLoop* loop) 
+    :Poller(loop),
+     epollfd_(epoll_create(8192)),
+     events_(kInitEventListSize) {
+    if (epollfd_ < 0) {
+        LOG_FATAL(g_logger) << "Create poll fd error.";
+    }
+}
+
+EPollPoller::~EPollPoller() {
+    ::close(epollfd_);
+}
+
+uint64_t EPollPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+    LOG_DEBUG(g_logger) << "fd total count " << channelCount_;
+    int numEvents = ::epoll_wait(epollfd_,
+                                &*events_.begin(),
+                                static_cast<int>(events_.size()),
+                                timeoutMs);
+    int savedErrno = errno;
+    uint64_t now_ms = fylee::GetMonotonicMS();
+    if (numEvents > 0) {
+        LOG_DEBUG(g_logger) << numEvents << " events happened";
+        fillActiveChannels(numEvents, activeChannels);
+        if (implicit_cast<size_t>(numEvents) == events_.size()) {
+            events_.resize(events_.size() * 2);
+        }
+    } else if (numEvents == 0) {
+        LOG_DEBUG(g_logger) << "nothing happened";
+    } else {
+        // error happens, log uncommon ones
+        if (savedErrno != EINTR) {
+            errno = savedErrno;
+            LOG_ERROR(g_logger) << "EPollPoller::poll()";
+        }
+    }
+    return now_ms;
+}
+
+void EPollPoller::fillActiveChannels(int numEvents, 
+                                ChannelList* activeChannels) const {
+    ASSERT(implicit_cast<size_t>(numEvents) <= events_.size());
+    for (int i = 0; i < numEvents; ++i) {
+        Channel* channel = static_cast<Channel*>(events_[i].data.ptr);
+    #ifndef NDEBUG
+        ASSERT(findChannel(channel->getFd()) == channel);
+    #endif
+        channel->setRevents(events_[i].events);
+        activeChannels->push_back(channel);
+    }
+}
+
+void EPollPoller::update(int operation, Channel* channel) {
+    struct epoll_event event;
+    bzero(&event, sizeof(event));
+    event.events = channel->getEvents();
+    event.data.ptr = channel;
+    int fd = channel->getFd();
+    if (epoll_ctl(epollfd_, operation, fd, &event) < 0) {
+        LOG_ERROR(g_logger) << "epoll_ctl failed op =" 
+                << operationToString(operation) << " fd =" << fd;
+    }
+}
+}
\ No newline at end of file
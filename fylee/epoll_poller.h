@@ -0,0 +1,35 @@
+#ifndef __FYLEE_EPOLL_POLLER_H_
+#define __FYLEE_EPOLL_POLLER_H_
+#include <sys/epoll.h>
+#include <vector>
+#include "poller.h"
+
+namespace fylee {
+
+/**
+ * @brief epoll 后端, 关注事件变化通过 epoll_ctl 提交
+ */
+class EPollPoller : public Poller {
+public:
+    EPollPoller(EventLoop* loop);
+    ~EPollPoller();
+
+    uint64_t poll(int timeoutMs, ChannelList* activeChannels) override;
+
+    const char* getName() const override { return "epoll"; }
+
+protected:
+    void update(int operation, Channel* channel) override;
+
+private:
+    typedef std::vector<struct epoll_event> EventList;
+    static const int kInitEventListSize = 16;
+
+    void fillActiveChannels(int numEvents,
+                            ChannelList* activeChannels) const;
+
+    int epollfd_;
+    EventList events_;
+};
+}
+#endif
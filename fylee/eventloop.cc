@@ -1,9 +1,13 @@
 #include "eventloop.h"
 #include "timerqueue.h"
+#include "timing_wheel.h"
+#include "config.h"
 #include "channel.h"
 #include "poller.h"
+#include "buffer.h"
 #include "log.h"
 #include "macro.h"
+#include <algorithm>
 #include <fcntl.h>
 #include <sys/eventfd.h>
 #include <sys/timerfd.h>
@@ -14,10 +18,34 @@ static fylee::Logger::ptr g_logger = LOG_NAME("system");
 static thread_local EventLoop* t_loopInThisThread = nullptr;
 static const int kPollTimeMs = 10000;
 
+static fylee::ConfigVar<bool>::ptr g_eventloop_timing_wheel =
+    fylee::Config::Lookup("eventloop.timing_wheel", false,
+                "use hierarchical timing wheel for runAt/runAfter/runEvery");
+
+static fylee::ConfigVar<uint64_t>::ptr g_eventloop_timing_wheel_tick_ms =
+    fylee::Config::Lookup("eventloop.timing_wheel.tick_ms", (uint64_t)10,
+                "timing wheel tick (resolution) in ms");
+
+static fylee::ConfigVar<uint32_t>::ptr g_eventloop_spin_us =
+    fylee::Config::Lookup("eventloop.spin_us", (uint32_t)0,
+                "busy poll with zero timeout for this many us after activity before blocking, 0 disables");
+
+static fylee::ConfigVar<bool>::ptr g_eventloop_timerfd =
+    fylee::Config::Lookup("eventloop.timerfd", true,
+                "wake up timers with timerfd, false computes the poll timeout from the earliest timer");
+
+static fylee::ConfigVar<uint32_t>::ptr g_eventloop_buffer_pool_max_free =
+    fylee::Config::Lookup("eventloop.buffer_pool.max_free", (uint32_t)1024,
+                "max free buffer nodes cached per loop");
+
 EventLoop* EventLoop::GetEventLoopOfCurrentThread() {
   return t_loopInThisThread;
 }
 
+uint64_t EventLoop::Now() {
+    return t_loopInThisThread ? t_loopInThisThread->now() : fylee::GetMonotonicMS();
+}
+
 static int createEventfd() {
     int evtfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     if (evtfd < 0) {
@@ -34,11 +62,23 @@ EventLoop::EventLoop()
      callingPendingFunctors_(false),
      iteration_(0),
      threadId_(fylee::GetThreadId()),
-     poller_(new Poller(this)),
-     timerQueue_(new TimerQueue(this)),
+     pollReturnTime_(fylee::GetMonotonicMS()),
+     now_(pollReturnTime_),
+     poller_(Poller::newDefaultPoller(this)),
+     useTimingWheel_(false),
+     useTimerfd_(g_eventloop_timerfd->getValue()),
+     spinUs_(g_eventloop_spin_us->getValue()),
+     spinUntilUs_(0),
+     blockingPolls_(0),
+     spinPolls_(0),
+     spinHits_(0),
      wakefd_(createEventfd()), 
-     currentActiveChannel_(nullptr) {
+     currentActiveChannel_(nullptr),
+     wakeupPending_(false),
+     connectionCount_(0),
+     bufferPool_(new BufferPool(g_eventloop_buffer_pool_max_free->getValue())) {
    
+    timerQueue_.reset(new TimerQueue(this, useTimerfd_));
     wakeupChannel_.reset(new Channel(this, wakefd_));
 
     LOG_DEBUG(g_logger) << "EventLoop created " << this << " in thread " << threadId_;
@@ -47,9 +87,13 @@ EventLoop::EventLoop()
                             << " exists in this thread " << threadId_;
     } else {
         t_loopInThisThread = this;
+        BufferPool::SetThis(bufferPool_);
     }
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
     wakeupChannel_->enableReading();
+    if (g_eventloop_timing_wheel->getValue()) {
+        setTimingWheel(true);
+    }
 }
 
 EventLoop::~EventLoop() {
@@ -59,6 +103,10 @@ EventLoop::~EventLoop() {
     wakeupChannel_->remove();
     close(wakefd_);
     t_loopInThisThread = nullptr;
+    // 还在外面的节点释放时直接 delete, 池随最后一个节点析构
+    BufferPool::SetThis(nullptr);
+    bufferPool_->destroy();
+    fylee::SetCachedTime(0);
 }
 
 void EventLoop::loop() {
@@ -70,7 +118,25 @@ void EventLoop::loop() {
 
     while (!quit_) {
         activeChannels_.clear();
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        int timeoutMs = pollTimeout();
+        // 本轮累积的关注事件变化, 每个 Channel 最多一次 epoll_ctl
+        poller_->flushUpdates();
+        bool spinning = spinUntilUs_ && fylee::GetMonotonicUS() < spinUntilUs_;
+        if (spinning) {
+            timeoutMs = 0;
+        }
+        pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        if (spinning) {
+            spinPolls_.fetch_add(1, std::memory_order_relaxed);
+            if (!activeChannels_.empty()) {
+                spinHits_.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else {
+            blockingPolls_.fetch_add(1, std::memory_order_relaxed);
+        }
+        now_ = pollReturnTime_;
+        // 本轮的日志都用这个时间, 不再每条日志调用一次 time(0)
+        fylee::SetCachedTime(time(0));
         ++iteration_;
         if (g_logger->getLevel() <= LogLevel::INFO) {
             printActiveChannels();
@@ -83,9 +149,17 @@ void EventLoop::loop() {
         }
         currentActiveChannel_ = nullptr;
         eventHandling_ = false;
-        doPendingFunctors();
+        if (!useTimerfd_) {
+            processTimers();
+        }
+        size_t tasks = doPendingFunctors();
+        // 有活动时延长自旋, 一直空闲到截止时间才回到阻塞等待
+        if (spinUs_ && (!activeChannels_.empty() || tasks)) {
+            spinUntilUs_ = fylee::GetMonotonicUS() + spinUs_;
+        }
     }
 
+    fylee::SetCachedTime(0);
     LOG_INFO(g_logger) << "EventLoop " << this << " stop looping";
     looping_ = false;
 }
@@ -98,31 +172,37 @@ void EventLoop::quit() {
     }
 }
 
-void EventLoop::runInLoop(Functor cb) {
+void EventLoop::runInLoop(Task task) {
     if (isInLoopThread()) {
-        cb();
+        task();
     } else {
-        queueInLoop(std::move(cb));
+        queueInLoop(std::move(task));
     }
 }
 
-void EventLoop::queueInLoop(Functor cb) {
-    {
-        MutexType::Lock lock(mutex_);
-        pendingFunctors_.push_back(std::move(cb));
-    }
+void EventLoop::queueInLoop(Task task) {
+    pendingFunctors_.push(std::move(task));
 
+    // 同一轮里多个生产者只需写一次 eventfd, doPendingFunctors 开始时清掉标记
     if (!isInLoopThread() || callingPendingFunctors_) {
-        wakeup();
+        if (!wakeupPending_.exchange(true, std::memory_order_acq_rel)) {
+            wakeup();
+        }
     }
 }
 
+void EventLoop::updateNow() {
+    assertInLoopThread();
+    now_ = fylee::GetMonotonicMS();
+    fylee::SetCachedTime(time(0));
+}
+
 size_t EventLoop::queueSize() const {
-    MutexType::Lock lock(mutex_);
     return pendingFunctors_.size();
 }
 
 Timer::ptr EventLoop::runAt(uint64_t time, Functor cb) {
+    // time 是墙上时间, 换算成相对时间后交给单调时钟的定时器
     uint64_t now_ms = fylee::GetCurrentMS();
     if(time >= now_ms) {
         return runAfter(time - now_ms, cb);
@@ -133,15 +213,65 @@ Timer::ptr EventLoop::runAt(uint64_t time, Functor cb) {
 
 Timer::ptr EventLoop::runAfter(uint64_t delay, Functor cb) {
     assertInLoopThread();
+    if (useTimingWheel_) {
+        return timingWheel_->addTimer(delay, std::move(cb), false);
+    }
     return timerQueue_->addTimer(delay, cb, false);
 }
 
 Timer::ptr EventLoop::runEvery(uint64_t interval, Functor cb) {
+    if (useTimingWheel_) {
+        return timingWheel_->addTimer(interval, std::move(cb), true);
+    }
     return timerQueue_->addTimer(interval, cb, true);
 }
 
 void EventLoop::cancel(Timer::ptr timer) {
-    timerQueue_->cancelTimer(timer);
+    if (timer->isWheelTimer()) {
+        timingWheel_->cancelTimer(timer);
+    } else {
+        timerQueue_->cancelTimer(timer);
+    }
+}
+
+Timer::ptr EventLoop::restartTimer(Timer::ptr timer, uint64_t delay) {
+    if (timer->isWheelTimer()) {
+        timingWheel_->restartTimer(timer, delay);
+    } else {
+        timerQueue_->restartTimer(timer, delay);
+    }
+    return timer;
+}
+
+TimerStats EventLoop::getTimerStats() const {
+    return timerQueue_->getStats();
+}
+
+void EventLoop::setTimingWheel(bool v) {
+    assertInLoopThread();
+    if (v && !timingWheel_) {
+        timingWheel_.reset(new TimingWheel(this, g_eventloop_timing_wheel_tick_ms->getValue(),
+                    useTimerfd_));
+    }
+    useTimingWheel_ = v;
+}
+
+void EventLoop::setSpinUs(uint32_t us) {
+    assertInLoopThread();
+    spinUs_ = us;
+    if (!us) {
+        spinUntilUs_ = 0;
+    }
+}
+
+LoopStats EventLoop::getLoopStats() const {
+    LoopStats stats;
+    stats.blockingPolls = blockingPolls_.load(std::memory_order_relaxed);
+    stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+    stats.spinHits = spinHits_.load(std::memory_order_relaxed);
+    stats.epollCtls = poller_->epollCtls();
+    stats.epollCtlsAvoided = poller_->epollCtlsAvoided();
+    return stats;
 }
 
 void EventLoop::updateChannel(Channel* channel) {
@@ -166,6 +296,21 @@ bool EventLoop::hasChannel(Channel* channel) {
     return poller_->hasChannel(channel);
 }
 
+BufferPoolStats EventLoop::getBufferPoolStats() const {
+    return bufferPool_->getStats();
+}
+
+bool EventLoop::setupCompletionRecv() {
+    assertInLoopThread();
+    return poller_->setupCompletionRecv();
+}
+
+int EventLoop::takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf) {
+    ASSERT(channel->ownerLoop() == this);
+    assertInLoopThread();
+    return poller_->takeReceived(channel, buf);
+}
+
 void EventLoop::abortNotInLoopThread() {
     LOG_FATAL(g_logger) << "EventLoop::abortNotInLoopThread - EventLoop " << this 
                 << " was created in threadId_ = " << threadId_
@@ -189,18 +334,49 @@ void EventLoop::handleRead() {
     }
 }
 
-void EventLoop::doPendingFunctors() {
-    std::vector<Functor> functors;
+size_t EventLoop::doPendingFunctors() {
     callingPendingFunctors_ = true;
-    {
-        MutexType::Lock lock(mutex_);
-        functors.swap(pendingFunctors_);
+    // 先清标记再取任务: 之后入队的生产者会重新写 eventfd, 不会漏掉
+    wakeupPending_.exchange(false, std::memory_order_acq_rel);
+    // 只处理此刻已在队列中的任务, 执行中再投递的留到下一轮
+    size_t n = pendingFunctors_.consume([](Task& task) {
+        task();
+    });
+    callingPendingFunctors_ = false;
+    return n;
+}
+
+int EventLoop::pollTimeout() {
+    // 两种定时器本轮的增删都在这里合并成最多一次重设
+    if (timingWheel_) {
+        timingWheel_->rearm();
     }
+    if (useTimerfd_) {
+        timerQueue_->rearm();
+        return kPollTimeMs;
+    }
+    uint64_t front = timerQueue_->getFrontTimer();
+    if (timingWheel_) {
+        front = std::min(front, timingWheel_->getFrontTimer());
+    }
+    if (front == ~0ull) {
+        return kPollTimeMs;
+    }
+    // 缓存的 now_ 落后于本轮事件处理的耗时, 这里读一次真实时钟
+    uint64_t now_ms = fylee::GetMonotonicMS();
+    if (front <= now_ms) {
+        return 0;
+    }
+    return static_cast<int>(std::min(front - now_ms, static_cast<uint64_t>(kPollTimeMs)));
+}
 
-    for (auto& functor : functors) {
-        functor();
+void EventLoop::processTimers() {
+    if (timerQueue_->getFrontTimer() <= now_) {
+        timerQueue_->processExpired();
+    }
+    if (timingWheel_ && timingWheel_->getFrontTimer() <= now_) {
+        timingWheel_->processExpired();
     }
-    callingPendingFunctors_ = false;
 }
 
 void EventLoop::printActiveChannels() const {
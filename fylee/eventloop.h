@@ -7,12 +7,34 @@
 #include "thread.h"
 #include "timer.h"
 #include "util.h"
+#include "mpsc_queue.h"
+#include "task.h"
 
 namespace fylee {
 
 class Channel;
 class Poller;
+class Buffer;
+class BufferPool;
+struct BufferPoolStats;
 class TimerQueue;
+class TimingWheel;
+
+/**
+ * @brief EventLoop 的 poll 统计, 用于权衡自旋消耗的 CPU 和延迟
+ */
+struct LoopStats {
+    /// 正常(可能阻塞)等待的 poll 次数
+    uint64_t blockingPolls = 0;
+    /// 自旋期间超时为 0 的 poll 次数
+    uint64_t spinPolls = 0;
+    /// 自旋 poll 中拿到事件的次数
+    uint64_t spinHits = 0;
+    /// 实际调用 epoll_ctl 的次数
+    uint64_t epollCtls = 0;
+    /// 合并或事件未变而省掉的 epoll_ctl 次数
+    uint64_t epollCtlsAvoided = 0;
+};
 
 class EventLoop : Noncopyable {
 public:
@@ -26,13 +48,36 @@ public:
 
     void quit();
 
+    /**
+     * @brief 本轮 poll 返回的时间, 单调时钟毫秒数(GetMonotonicMS)
+     */
     uint64_t pollReturnTime() const { return pollReturnTime_; }
 
+    /**
+     * @brief 缓存的单调时钟毫秒数, 每轮 poll 返回后刷新一次
+     * @details 定时器、连接时间戳都用它计算, 同一轮事件处理中不再重复读时钟;
+     *          不受 NTP 等调整系统时间的影响. 只在 loop 线程读取才有意义
+     */
+    uint64_t now() const { return now_; }
+
+    /**
+     * @brief 立即重新读取时钟刷新 now(), 用于耗时较长的回调之后
+     */
+    void updateNow();
+
     int64_t iteration() const { return iteration_; }
 
-    void runInLoop(Functor cb);
+    /**
+     * @brief 在 loop 线程执行 task, 当前就在 loop 线程时直接执行
+     * @details Task 可由 std::function、lambda、std::bind 结果隐式构造,
+     *          小于 Task::kInlineSize 的可调用对象投递时不分配内存
+     */
+    void runInLoop(Task task);
 
-    void queueInLoop(Functor cb);
+    /**
+     * @brief 把 task 放入队列, 在本轮事件处理之后执行
+     */
+    void queueInLoop(Task task);
 
     size_t queueSize() const;
 
@@ -44,11 +89,68 @@ public:
  
     void cancel(Timer::ptr timer);
 
+    /**
+     * @brief 把定时器重新设为 delay 毫秒后到期, 返回同一个 timer
+     * @details 原地重设, 不分配内存: 时间轮上 O(1), 定时器堆上 O(log n).
+     *          已触发的一次性定时器也可以重设, 已取消的定时器重设无效
+     */
+    Timer::ptr restartTimer(Timer::ptr timer, uint64_t delay);
+
+    /**
+     * @brief 定时器堆(非时间轮)的统计, 可在任意线程调用
+     */
+    TimerStats getTimerStats() const;
+
+    /**
+     * @brief 之后的 runAt/runAfter/runEvery 是否使用分层时间轮, 需在 loop 线程调用
+     * @details 默认值取自配置 eventloop.timing_wheel. 切换不影响已有的定时器,
+     *          时间轮精度为 eventloop.timing_wheel.tick_ms
+     */
+    void setTimingWheel(bool v);
+    bool isTimingWheel() const { return useTimingWheel_; }
+
+    /**
+     * @brief 定时器是否通过 timerfd 唤醒 loop
+     * @details 取自配置 eventloop.timerfd, 构造时确定. 为 false 时不创建 timerfd,
+     *          每轮按最近的定时器计算 poll 的超时时间, 省掉 timerfd_settime 和 timerfd 的读事件
+     */
+    bool isTimerfd() const { return useTimerfd_; }
+
+    /**
+     * @brief 设置自旋时长(微秒), 0 表示不自旋, 需在 loop 线程调用
+     * @details 有事件或任务处理后的 us 微秒内以超时 0 轮询, 之后才回到阻塞等待,
+     *          用 CPU 换取更低的唤醒延迟, 适合独占核心的 loop. 默认值取自配置 eventloop.spin_us
+     */
+    void setSpinUs(uint32_t us);
+    uint32_t getSpinUs() const { return spinUs_; }
+
+    /**
+     * @brief poll 统计, 可在任意线程调用
+     */
+    LoopStats getLoopStats() const;
+
+    /**
+     * @brief 本 loop 的 Buffer 节点池统计, 可在任意线程调用
+     * @details 空闲节点数上限取自配置 eventloop.buffer_pool.max_free
+     */
+    BufferPoolStats getBufferPoolStats() const;
+
     void wakeup();
     void updateChannel(Channel* channel);
     void removeChannel(Channel* channel);
     bool hasChannel(Channel* channel);
 
+    /**
+     * @brief Poller 是否支持完成模式接收(io_uring multishot recv), 需在 loop 线程调用
+     * @details 首次调用时注册缓冲区环, 之后直接返回结果
+     */
+    bool setupCompletionRecv();
+
+    /**
+     * @brief 取出完成模式下 channel 已收到的数据追加到 buf, 语义同 read, 需在 loop 线程调用
+     */
+    int takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf);
+
     void assertInLoopThread() {
         if (!isInLoopThread()) {
             abortNotInLoopThread();
@@ -58,14 +160,34 @@ public:
 
     bool eventHandling() const { return eventHandling_; }
 
+    /**
+     * @brief 分配到本 loop 上的活跃连接数, 可在任意线程读取
+     * @details 由 TcpServer 在分配连接时加一, 移除连接时减一, 用于最少连接负载均衡
+     */
+    size_t connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+    void incConnectionCount() { connectionCount_.fetch_add(1, std::memory_order_relaxed); }
+    void decConnectionCount() { connectionCount_.fetch_sub(1, std::memory_order_relaxed); }
+
     static EventLoop* GetEventLoopOfCurrentThread();
 
+    /**
+     * @brief 当前线程所属 loop 缓存的 now(), 当前线程没有 loop 时直接读单调时钟
+     */
+    static uint64_t Now();
+
 private:
     void abortNotInLoopThread();
 
     void handleRead();  // waked up
 
-    void doPendingFunctors();
+    /// 返回执行的任务数
+    size_t doPendingFunctors();
+
+    /// 计算本轮 poll 的超时毫秒数, 使用 timerfd 时顺便重设 timerfd
+    int pollTimeout();
+
+    /// 不使用 timerfd 时, poll 返回后执行到期的定时器
+    void processTimers();
 
     void printActiveChannels() const; // DEBUG
 
@@ -78,16 +200,31 @@ private:
     int64_t iteration_;
     const pid_t threadId_;
     uint64_t pollReturnTime_;
+    uint64_t now_;
     std::unique_ptr<Poller> poller_;
     std::unique_ptr<TimerQueue> timerQueue_;
+    std::unique_ptr<TimingWheel> timingWheel_;
+    bool useTimingWheel_;
+    const bool useTimerfd_;
+    uint32_t spinUs_;
+    // 自旋截止的单调时钟微秒数
+    uint64_t spinUntilUs_;
+    std::atomic<uint64_t> blockingPolls_;
+    std::atomic<uint64_t> spinPolls_;
+    std::atomic<uint64_t> spinHits_;
     int wakefd_;
     std::unique_ptr<Channel> wakeupChannel_;
 
     // scratch variables
     ChannelList activeChannels_;
     Channel* currentActiveChannel_;
-    mutable MutexType mutex_;
-    std::vector<Functor> pendingFunctors_;
+    // 跨线程投递的任务, 无锁多生产者单消费者队列
+    MpscQueue<Task> pendingFunctors_;
+    // 已写过 eventfd 但 loop 还没处理, 期间其它生产者不必再写
+    std::atomic<bool> wakeupPending_;
+    std::atomic<size_t> connectionCount_;
+    // 本线程 Buffer 节点的空闲链表
+    BufferPool* bufferPool_;
 
 };
 } 
@@ -65,6 +65,32 @@ EventLoop* EventLoopThreadPool::getLoopForHash(size_t hashCode) {
     return loop;
 }
 
+EventLoop* EventLoopThreadPool::getLeastLoadedLoop() {
+    baseLoop_->assertInLoopThread();
+    ASSERT(started_);
+    if (loops_.empty()) {
+        return baseLoop_;
+    }
+
+    size_t n = loops_.size();
+    size_t start = implicit_cast<size_t>(next_);
+    EventLoop* loop = loops_[start];
+    size_t least = loop->connectionCount();
+    for (size_t i = 1; i < n && least > 0; ++i) {
+        EventLoop* cur = loops_[(start + i) % n];
+        size_t count = cur->connectionCount();
+        if (count < least) {
+            loop = cur;
+            least = count;
+        }
+    }
+    ++next_;
+    if (implicit_cast<size_t>(next_) >= n) {
+        next_ = 0;
+    }
+    return loop;
+}
+
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoops() {
     baseLoop_->assertInLoopThread();
     ASSERT(started_);
@@ -26,6 +26,9 @@ public:
     /// with the same hash code, it will always return the same EventLoop
     EventLoop* getLoopForHash(size_t hashCode);
 
+    /// 活跃连接数最少的 EventLoop, 连接数相同时从轮询位置开始选, 避免总落在第一个
+    EventLoop* getLeastLoadedLoop();
+
     std::vector<EventLoop*> getAllLoops();
 
     bool started() const { return started_; }
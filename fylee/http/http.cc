@@ -1,5 +1,6 @@
 #include "http.h"
 #include "fylee/util.h"
+#include "fylee/buffer.h"
 
 namespace fylee {
 namespace http {
@@ -55,6 +56,110 @@ bool CaseInsensitiveLess::operator()(const std::string& lhs
     return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
 }
 
+uint32_t HttpHeaders::Hash(const char* str, size_t len) {
+    // FNV-1a, 按小写计算
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        if(c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+const HttpHeaders::Entry* HttpHeaders::find(const char* key, size_t len, uint32_t hash) const {
+    for(auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+        if(it->hash == hash && it->keyLength == len
+                && strncasecmp(keyData(*it), key, len) == 0) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+const HttpHeaders::Entry* HttpHeaders::find(const std::string& key) const {
+    return find(key.c_str(), key.size(), Hash(key.c_str(), key.size()));
+}
+
+std::string HttpHeaders::get(const std::string& key, const std::string& def) const {
+    auto e = find(key);
+    return e ? value(*e) : def;
+}
+
+void HttpHeaders::set(const std::string& key, const std::string& val) {
+    uint32_t hash = Hash(key.c_str(), key.size());
+    Entry* e = const_cast<Entry*>(find(key.c_str(), key.size(), hash));
+    if(!e) {
+        entries_.push_back(Entry());
+        e = &entries_.back();
+        e->hash = hash;
+        e->keyOffset = data_.size();
+        e->keyLength = key.size();
+        data_.append(key);
+    }
+    // 覆盖时旧值留在 data_ 中, clear() 时一并回收
+    e->valOffset = data_.size();
+    e->valLength = val.size();
+    data_.append(val);
+}
+
+void HttpHeaders::addSlice(const char* base, const char* key, size_t klen,
+                           const char* val, size_t vlen) {
+    Entry e;
+    e.hash = Hash(key, klen);
+    e.keyOffset = key - base;
+    e.keyLength = klen;
+    e.valOffset = val - base;
+    e.valLength = vlen;
+    entries_.push_back(e);
+}
+
+void HttpHeaders::adopt(std::string& buf) {
+    data_.swap(buf);
+    buf.clear();
+}
+
+void HttpHeaders::erase(const std::string& key) {
+    uint32_t hash = Hash(key.c_str(), key.size());
+    for(auto it = entries_.begin(); it != entries_.end();) {
+        if(it->hash == hash && it->keyLength == key.size()
+                && strncasecmp(keyData(*it), key.c_str(), key.size()) == 0) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HttpHeaders::clear() {
+    data_.clear();
+    entries_.clear();
+}
+
+void HttpHeaders::clear(size_t maxKeep) {
+    if(data_.capacity() > maxKeep) {
+        std::string().swap(data_);
+    }
+    if(entries_.capacity() * sizeof(Entry) > maxKeep) {
+        std::vector<Entry>().swap(entries_);
+    }
+    clear();
+}
+
+/// 回到对象池时保留的 body/头部存储上限, 大请求用过的内存不会被空闲对象一直占着
+static const size_t s_pooled_capacity = 8192;
+
+static void ClearString(std::string& str) {
+    if(str.capacity() > s_pooled_capacity) {
+        std::string().swap(str);
+    } else {
+        str.clear();
+    }
+}
+
 HttpRequest::HttpRequest(uint8_t version, bool close)
     :method_(HttpMethod::GET)
     ,version_(version)
@@ -64,10 +169,24 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
     ,path_("/") {
 }
 
+void HttpRequest::reset() {
+    method_ = HttpMethod::GET;
+    version_ = 0x11;
+    close_ = true;
+    websocket_ = false;
+    parserParamFlag_ = 0;
+    path_ = "/";
+    query_.clear();
+    fragment_.clear();
+    ClearString(body_);
+    headers_.clear(s_pooled_capacity);
+    params_.clear();
+    cookies_.clear();
+}
+
 std::string HttpRequest::getHeader(const std::string& key
                             ,const std::string& def) const {
-    auto it = headers_.find(key);
-    return it == headers_.end() ? def : it->second;
+    return headers_.get(key, def);
 }
 
 std::shared_ptr<HttpResponse> HttpRequest::createResponse() {
@@ -92,7 +211,7 @@ std::string HttpRequest::getCookie(const std::string& key
 }
 
 void HttpRequest::setHeader(const std::string& key, const std::string& val) {
-    headers_[key] = val;
+    headers_.set(key, val);
 }
 
 void HttpRequest::setParam(const std::string& key, const std::string& val) {
@@ -116,12 +235,12 @@ void HttpRequest::delCookie(const std::string& key) {
 }
 
 bool HttpRequest::hasHeader(const std::string& key, std::string* val) {
-    auto it = headers_.find(key);
-    if(it == headers_.end()) {
+    auto e = headers_.find(key);
+    if(!e) {
         return false;
     }
     if(val) {
-        *val = it->second;
+        *val = headers_.value(*e);
     }
     return true;
 }
@@ -177,10 +296,12 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
         os << "connection: " << (close_ ? "close" : "keep-alive") << "\r\n";
     }
     for(auto& i : headers_) {
-        if(!websocket_ && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if(!websocket_ && i.keyLength == 10
+                && strncasecmp(headers_.keyData(i), "connection", 10) == 0) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        os.write(headers_.keyData(i), i.keyLength) << ": ";
+        os.write(headers_.valueData(i), i.valLength) << "\r\n";
     }
 
     if(!body_.empty()) {
@@ -193,13 +314,12 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
 }
 
 void HttpRequest::init() {
+    // HTTP/1.1默认长连接, HTTP/1.0需显式keep-alive
     std::string conn = getHeader("connection");
-    if(!conn.empty()) {
-        if(strcasecmp(conn.c_str(), "keep-alive") == 0) {
-            close_ = false;
-        } else {
-            close_ = true;
-        }
+    if(version_ >= 0x11) {
+        close_ = strcasecmp(conn.c_str(), "close") == 0;
+    } else {
+        close_ = strcasecmp(conn.c_str(), "keep-alive") != 0;
     }
 }
 
@@ -267,16 +387,28 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
     :status_(HttpStatus::OK)
     ,version_(version)
     ,close_(close)
-    ,websocket_(false) {
+    ,websocket_(false)
+    ,stream_(false) {
+}
+
+void HttpResponse::reset() {
+    status_ = HttpStatus::OK;
+    version_ = 0x11;
+    close_ = true;
+    websocket_ = false;
+    stream_ = false;
+    ClearString(body_);
+    reason_.clear();
+    headers_.clear(s_pooled_capacity);
+    cookies_.clear();
 }
 
 std::string HttpResponse::getHeader(const std::string& key, const std::string& def) const {
-    auto it = headers_.find(key);
-    return it == headers_.end() ? def : it->second;
+    return headers_.get(key, def);
 }
 
 void HttpResponse::setHeader(const std::string& key, const std::string& val) {
-    headers_[key] = val;
+    headers_.set(key, val);
 }
 
 void HttpResponse::delHeader(const std::string& key) {
@@ -314,6 +446,12 @@ std::string HttpResponse::toString() const {
     return ss.str();
 }
 
+/// 1xx、204、304 响应没有消息体, 也不带 content-length
+static bool StatusHasNoBody(HttpStatus status) {
+    return (uint32_t)status < 200 || status == HttpStatus::NO_CONTENT
+            || status == HttpStatus::NOT_MODIFIED;
+}
+
 std::ostream& HttpResponse::dump(std::ostream& os) const {
     os << "HTTP/"
        << ((uint32_t)(version_ >> 4))
@@ -326,10 +464,12 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
        << "\r\n";
 
     for(auto& i : headers_) {
-        if(!websocket_ && strcasecmp(i.first.c_str(), "connection") == 0) {
+        if(!websocket_ && i.keyLength == 10
+                && strncasecmp(headers_.keyData(i), "connection", 10) == 0) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        os.write(headers_.keyData(i), i.keyLength) << ": ";
+        os.write(headers_.valueData(i), i.valLength) << "\r\n";
     }
     for(auto& i : cookies_) {
         os << "Set-Cookie: " << i << "\r\n";
@@ -337,7 +477,7 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
     if(!websocket_) {
         os << "connection: " << (close_ ? "close" : "keep-alive") << "\r\n";
     }
-    if(!body_.empty()) {
+    if(!StatusHasNoBody(status_)) {
         os << "content-length: " << body_.size() << "\r\n\r\n"
            << body_;
     } else {
@@ -346,6 +486,113 @@ std::ostream& HttpResponse::dump(std::ostream& os) const {
     return os;
 }
 
+static inline void AppendString(Buffer::ptr buf, const std::string& str) {
+    buf->write(str.c_str(), str.size());
+}
+
+static inline void AppendString(Buffer::ptr buf, const char* str) {
+    buf->write(str, strlen(str));
+}
+
+/**
+ * @brief 查找预先拼好的状态行, 由 HTTP_STATUS_MAP 在编译期生成
+ * @return 找到返回状态行, 否则返回 nullptr
+ */
+static const char* GetStatusLine(uint8_t version, HttpStatus status, size_t& len) {
+#define XX(code, name, msg) \
+        case HttpStatus::name: \
+            len = sizeof(VERSION " " #code " " #msg "\r\n") - 1; \
+            return VERSION " " #code " " #msg "\r\n";
+
+    if(version == 0x11) {
+#define VERSION "HTTP/1.1"
+        switch(status) {
+            HTTP_STATUS_MAP(XX);
+            default:
+                return nullptr;
+        }
+#undef VERSION
+    } else if(version == 0x10) {
+#define VERSION "HTTP/1.0"
+        switch(status) {
+            HTTP_STATUS_MAP(XX);
+            default:
+                return nullptr;
+        }
+#undef VERSION
+    }
+#undef XX
+    return nullptr;
+}
+
+void HttpResponse::dump(Buffer::ptr buf, const std::string* const* presets, size_t count) const {
+    static const std::string s_connection = "connection";
+    char line[64];
+    size_t len = 0;
+    const char* status_line = reason_.empty() ? GetStatusLine(version_, status_, len) : nullptr;
+    if(status_line) {
+        buf->write(status_line, len);
+    } else {
+        int n = snprintf(line, sizeof(line), "HTTP/%u.%u %u ",
+                         (uint32_t)(version_ >> 4), (uint32_t)(version_ & 0x0F),
+                         (uint32_t)status_);
+        buf->write(line, n);
+        if(reason_.empty()) {
+            AppendString(buf, HttpStatusToString(status_));
+        } else {
+            AppendString(buf, reason_);
+        }
+        AppendString(buf, "\r\n");
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        AppendString(buf, *presets[i]);
+    }
+
+    // connection 头由下面统一输出, 只查一次而不是逐个 strcasecmp
+    auto conn = websocket_ ? nullptr : headers_.find(s_connection);
+    for(auto& i : headers_) {
+        if(&i == conn) {
+            continue;
+        }
+        buf->write(headers_.keyData(i), i.keyLength);
+        AppendString(buf, ": ");
+        buf->write(headers_.valueData(i), i.valLength);
+        AppendString(buf, "\r\n");
+    }
+    for(auto& i : cookies_) {
+        AppendString(buf, "Set-Cookie: ");
+        AppendString(buf, i);
+        AppendString(buf, "\r\n");
+    }
+    if(!websocket_) {
+        AppendString(buf, close_ ? "connection: close\r\n"
+                                 : "connection: keep-alive\r\n");
+    }
+    if(stream_) {
+        // 流式响应没有 content-length, HTTP/1.0 以关闭连接结束, 已设置的 body 作为第一段数据
+        if(version_ >= 0x11) {
+            AppendString(buf, "transfer-encoding: chunked\r\n\r\n");
+            if(!body_.empty()) {
+                int n = snprintf(line, sizeof(line), "%zx\r\n", body_.size());
+                buf->write(line, n);
+                AppendString(buf, body_);
+                AppendString(buf, "\r\n");
+            }
+        } else {
+            AppendString(buf, "\r\n");
+            AppendString(buf, body_);
+        }
+    } else if(!StatusHasNoBody(status_)) {
+        // 长连接上客户端靠 content-length 判断响应结束, 空消息体也要写 0
+        int n = snprintf(line, sizeof(line), "content-length: %zu\r\n\r\n", body_.size());
+        buf->write(line, n);
+        AppendString(buf, body_);
+    } else {
+        AppendString(buf, "\r\n");
+    }
+}
+
 std::ostream& operator<<(std::ostream& os, const HttpRequest& req) {
     return req.dump(os);
 }
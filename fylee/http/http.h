@@ -10,6 +10,7 @@
 #include <boost/lexical_cast.hpp>
 
 namespace fylee {
+class Buffer;
 namespace http {
 
 /* Request Methods */
@@ -222,6 +223,126 @@ T getAs(const MapType& m, const std::string& key, const T& def = T()) {
     return def;
 }
 
+/**
+ * @brief HTTP头部容器
+ * @details 所有键值连续存放在 data_ 中, entries_ 只记录偏移、长度和键的大小写无关哈希,
+ *          clear() 后保留容量, 配合对象池复用时不再逐个分配节点.
+ *          解析请求时可以先用 addSlice() 记录位于接收缓冲中的切片, 解析完成后用
+ *          adopt() 接管该缓冲, 头部字节不做拷贝.
+ *          同名头部查找时后出现的优先, 与原先 map 覆盖的语义一致.
+ */
+class HttpHeaders {
+public:
+    /// 单个头部在 data_ 中的位置
+    struct Entry {
+        uint32_t hash;
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t valOffset;
+        uint32_t valLength;
+    };
+    typedef std::vector<Entry>::const_iterator const_iterator;
+
+    /**
+     * @brief 设置头部, 已存在则覆盖
+     */
+    void set(const std::string& key, const std::string& val);
+
+    /**
+     * @brief 记录一个位于外部缓冲 base 中的头部切片, 之后必须 adopt() 该缓冲
+     * @param[in] base 外部缓冲起始地址, key 和 val 均指向其中
+     */
+    void addSlice(const char* base, const char* key, size_t klen,
+                  const char* val, size_t vlen);
+
+    /**
+     * @brief 接管 addSlice() 时使用的缓冲, 与 buf 交换内容
+     * @param[in, out] buf 接收缓冲, 返回时为本容器原先(已清空)的存储
+     */
+    void adopt(std::string& buf);
+
+    /**
+     * @brief 查找头部, 大小写无关
+     * @return 找到返回对应项, 否则返回 nullptr
+     */
+    const Entry* find(const std::string& key) const;
+
+    bool has(const std::string& key) const { return find(key) != nullptr;}
+
+    std::string get(const std::string& key, const std::string& def = "") const;
+
+    /**
+     * @brief 删除所有同名头部
+     */
+    void erase(const std::string& key);
+
+    void clear();
+
+    /**
+     * @brief 清空, 存储超过 maxKeep 字节时一并释放, 避免对象池中的对象一直占着大块内存
+     */
+    void clear(size_t maxKeep);
+
+    size_t size() const { return entries_.size();}
+
+    bool empty() const { return entries_.empty();}
+
+    const_iterator begin() const { return entries_.begin();}
+
+    const_iterator end() const { return entries_.end();}
+
+    const char* keyData(const Entry& e) const { return data_.data() + e.keyOffset;}
+
+    const char* valueData(const Entry& e) const { return data_.data() + e.valOffset;}
+
+    std::string key(const Entry& e) const { return std::string(keyData(e), e.keyLength);}
+
+    std::string value(const Entry& e) const { return std::string(valueData(e), e.valLength);}
+private:
+    static uint32_t Hash(const char* str, size_t len);
+    const Entry* find(const char* key, size_t len, uint32_t hash) const;
+private:
+    /// 键值存储
+    std::string data_;
+    /// 按出现顺序排列的头部
+    std::vector<Entry> entries_;
+};
+
+/**
+ * @brief 获取HttpHeaders中的key值,并转成对应类型,返回是否成功
+ */
+template<class T>
+bool checkGetAs(const HttpHeaders& m, const std::string& key, T& val, const T& def = T()) {
+    auto e = m.find(key);
+    if(!e) {
+        val = def;
+        return false;
+    }
+    try {
+        val = boost::lexical_cast<T>(m.valueData(*e), e->valLength);
+        return true;
+    } catch (...) {
+        val = def;
+    }
+    return false;
+}
+
+/**
+ * @brief 获取HttpHeaders中的key值,并转成对应类型
+ */
+template<class T>
+T getAs(const HttpHeaders& m, const std::string& key, const T& def = T()) {
+    auto e = m.find(key);
+    if(!e) {
+        return def;
+    }
+    try {
+        return boost::lexical_cast<T>(m.valueData(*e), e->valLength);
+    } catch (...) {
+    }
+    return def;
+}
+
 class HttpResponse;
 /**
  * @brief HTTP请求结构
@@ -239,6 +360,11 @@ public:
      */
     HttpRequest(uint8_t version = 0x11, bool close = true);
 
+    /**
+     * @brief 恢复为刚构造时的状态, 供对象池复用
+     */
+    void reset();
+
     std::shared_ptr<HttpResponse> createResponse();
 
     /**
@@ -269,7 +395,12 @@ public:
     /**
      * @brief 返回HTTP请求的消息头MAP
      */
-    const MapType& getHeaders() const { return headers_;}
+    const HttpHeaders& getHeaders() const { return headers_;}
+
+    /**
+     * @brief 返回可修改的消息头, 供解析器直接写入切片
+     */
+    HttpHeaders& getHeaders() { return headers_;}
 
     /**
      * @brief 返回HTTP请求的参数MAP
@@ -317,6 +448,8 @@ public:
      */
     void setBody(const std::string& v) { body_ = v;}
 
+    void setBody(std::string&& v) { body_ = std::move(v);}
+
     /**
      * @brief 是否自动关闭
      */
@@ -341,7 +474,7 @@ public:
      * @brief 设置HTTP请求的头部MAP
      * @param[in] v map
      */
-    void setHeaders(const MapType& v) { headers_ = v;}
+    void setHeaders(const HttpHeaders& v) { headers_ = v;}
 
     /**
      * @brief 设置HTTP请求的参数MAP
@@ -562,7 +695,7 @@ private:
     /// 请求消息体
     std::string body_;
     /// 请求头部MAP
-    MapType headers_;
+    HttpHeaders headers_;
     /// 请求参数MAP
     MapType params_;
     /// 请求Cookie MAP
@@ -585,6 +718,11 @@ public:
      */
     HttpResponse(uint8_t version = 0x11, bool close = true);
 
+    /**
+     * @brief 恢复为刚构造时的状态, 供对象池复用
+     */
+    void reset();
+
     /**
      * @brief 返回响应状态
      * @return 请求状态
@@ -612,7 +750,7 @@ public:
      * @brief 返回响应头部MAP
      * @return MAP
      */
-    const MapType& getHeaders() const { return headers_;}
+    const HttpHeaders& getHeaders() const { return headers_;}
 
     /**
      * @brief 设置响应状态
@@ -642,7 +780,7 @@ public:
      * @brief 设置响应头部MAP
      * @param[in] v MAP
      */
-    void setHeaders(const MapType& v) { headers_ = v;}
+    void setHeaders(const HttpHeaders& v) { headers_ = v;}
 
     /**
      * @brief 是否自动关闭
@@ -664,6 +802,16 @@ public:
      */
     void setWebsocket(bool v) { websocket_ = v;}
 
+    /**
+     * @brief 是否流式响应(长度未知, HTTP/1.1 使用 chunked 编码)
+     */
+    bool isStream() const { return stream_;}
+
+    /**
+     * @brief 设置是否流式响应, 一般由 HttpSession::beginChunked 设置
+     */
+    void setStream(bool v) { stream_ = v;}
+
     /**
      * @brief 获取响应头部参数
      * @param[in] key 关键字
@@ -685,6 +833,12 @@ public:
      */
     void delHeader(const std::string& key);
 
+    /**
+     * @brief 判断响应头部参数是否存在
+     * @param[in] key 关键字
+     */
+    bool hasHeader(const std::string& key) const { return headers_.has(key);}
+
     /**
      * @brief 检查并获取响应头部参数
      * @tparam T 值类型
@@ -717,6 +871,15 @@ public:
      */
     std::ostream& dump(std::ostream& os) const;
 
+    /**
+     * @brief 序列化追加到 Buffer 末尾, 不经过 stringstream 和中间 string
+     * @param[in, out] buf 输出缓冲, 写入后 position 位于末尾
+     * @param[in] presets 预先渲染好的公共头部行(如 Server、Date), 每行以 \r\n 结尾
+     * @param[in] count presets 个数
+     */
+    void dump(std::shared_ptr<Buffer> buf, const std::string* const* presets = nullptr,
+              size_t count = 0) const;
+
     /**
      * @brief 转成字符串
      */
@@ -735,12 +898,14 @@ private:
     bool close_;
     /// 是否为websocket
     bool websocket_;
+    /// 是否流式响应
+    bool stream_;
     /// 响应消息体
     std::string body_;
     /// 响应原因
     std::string reason_;
     /// 响应头部MAP
-    MapType headers_;
+    HttpHeaders headers_;
 
     std::vector<std::string> cookies_;
 };
@@ -14,6 +14,8 @@ typedef struct http_parser {
   size_t query_start;
   int xml_sent;
   int json_sent;
+  /* 整段请求头已就绪时先走 SIMD 快速路径, 默认开启 */
+  int fast_scan;
 
   void *data;
 
@@ -32,6 +34,8 @@ typedef struct http_parser {
 int http_parser_init(http_parser *parser);
 int http_parser_finish(http_parser *parser);
 size_t http_parser_execute(http_parser *parser, const char *data, size_t len, size_t off);
+/* 请求头完整且属于常见形式时一次解析完成返回 1, 否则不触发任何回调并返回 0 */
+int http_parser_execute_fast(http_parser *parser, const char *data, size_t len);
 int http_parser_has_error(http_parser *parser);
 int http_parser_is_finished(http_parser *parser);
 
@@ -33,6 +33,7 @@
  */
 
 #include "http11_parser.h"
+#include "http_scan.h"
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -259,6 +260,160 @@ main := (Request | SocketRequest) @done;
 /** Data **/
 %% write data;
 
+/** fast path **/
+
+/* 
+ * 整段请求头已在缓冲中时, 先用 SIMD 按行定位 CRLF 后整行交给回调, 不逐字节走状态机.
+ * 只接受状态机所接受语言的一个严格子集(CRLF 行尾, origin-form URI, 无折行/空值, 制表符只作冒号后的空白),
+ * 遇到其它情况在调用任何回调之前返回 0, 由状态机处理.
+ */
+#define HTTP_FAST_MAX_FIELDS 64
+
+static int http_fast_is_token(unsigned char c) {
+  if(c <= 0x20 || c >= 0x7f) return 0;
+  switch(c) {
+    case '(': case ')': case '<': case '>': case '@':
+    case ',': case ';': case ':': case '\\': case '"':
+    case '/': case '[': case ']': case '?': case '=':
+    case '{': case '}':
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+/* pchar 去掉 pct_encoded, 不含 uri_relaxed 时才允许的 {}^ */
+static int http_fast_is_pchar(unsigned char c) {
+  if(c >= 0x80) return 1;
+  if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) return 1;
+  switch(c) {
+    case '-': case '.': case '_': case '~':
+    case '!': case '$': case '&': case '\'': case '(': case ')':
+    case '*': case '+': case ',': case ';': case '=':
+    case ':': case '@':
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int http_fast_check_uri(const char *p, const char *pe, int allow_question) {
+  for(; p < pe; ++p) {
+    unsigned char c = *p;
+    if(c == '%') {
+      if(pe - p < 3 || !isxdigit((unsigned char)p[1]) || !isxdigit((unsigned char)p[2])) return 0;
+      p += 2;
+    } else if(!(c == '/' || http_fast_is_pchar(c) || (allow_question && c == '?'))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int http_parser_execute_fast(http_parser *parser, const char *buffer, size_t len) {
+  struct {
+    const char *field;
+    size_t flen;
+    const char *value;
+    size_t vlen;
+  } fields[HTTP_FAST_MAX_FIELDS];
+  size_t nfields = 0;
+  size_t i = 0;
+  const char *pe = buffer + len;
+  const char *p = buffer;
+  const char *line_end, *method_end, *uri, *uri_end, *version;
+  const char *path_end, *query, *target_end, *frag;
+
+  if(parser->cs != http_parser_start) return 0;
+
+  /* Request-Line */
+  line_end = fylee::http::FindControl(p, pe);
+  if(pe - line_end < 2 || line_end[0] != '\r' || line_end[1] != '\n') return 0;
+
+  for(method_end = p; method_end < line_end
+        && ((*method_end >= 'A' && *method_end <= 'Z') || (*method_end >= '0' && *method_end <= '9'));
+        ++method_end);
+  if(method_end == p || method_end - p > 20 || method_end == line_end || *method_end != ' ') return 0;
+
+  uri = method_end + 1;
+  uri_end = (const char *)memchr(uri, ' ', line_end - uri);
+  if(uri_end == NULL) return 0;
+  version = uri_end + 1;
+  if(line_end - version != 8 || memcmp(version, "HTTP/1.", 7) != 0
+        || (version[7] != '0' && version[7] != '1')) return 0;
+
+  /* 只处理 path_absolute 形式, "//" 开头的 authority 形式交给状态机 */
+  if(uri == uri_end || uri[0] != '/' || (uri_end - uri > 1 && uri[1] == '/')) return 0;
+  frag = (const char *)memchr(uri, '#', uri_end - uri);
+  target_end = frag ? frag : uri_end;
+  query = (const char *)memchr(uri, '?', target_end - uri);
+  path_end = query ? query : target_end;
+  if(!http_fast_check_uri(uri, path_end, 0)) return 0;
+  if(query) {
+    ++query;
+    if(query == target_end || !http_fast_check_uri(query, target_end, 1)) return 0;
+  }
+  if(frag) {
+    ++frag;
+    if(frag == uri_end || !http_fast_check_uri(frag, uri_end, 1)) return 0;
+  }
+
+  /* message-header */
+  p = line_end + 2;
+  for(;;) {
+    const char *name, *name_end, *value, *eol;
+    if(pe - p < 2) return 0;
+    if(p[0] == '\r') {
+      if(p[1] != '\n') return 0;
+      p += 2;
+      break;
+    }
+    name = p;
+    while(p < pe && http_fast_is_token(*p)) ++p;
+    if(p == name || p == pe || *p != ':') return 0;
+    name_end = p++;
+    while(p < pe && (*p == ' ' || *p == '\t')) ++p;
+    value = p;
+    eol = fylee::http::FindControl(p, pe);
+    /* 空值、值内的制表符(FindControl 会停在那里)、裸 LF 和以空格/制表符开头的折行都交给状态机 */
+    if(eol == value || pe - eol < 3 || eol[0] != '\r' || eol[1] != '\n'
+          || eol[2] == ' ' || eol[2] == '\t') return 0;
+    if(nfields == HTTP_FAST_MAX_FIELDS) return 0;
+    fields[nfields].field = name;
+    fields[nfields].flen = name_end - name;
+    fields[nfields].value = value;
+    fields[nfields].vlen = eol - value;
+    ++nfields;
+    p = eol + 2;
+  }
+
+  /* 校验全部通过, 按状态机的顺序触发回调 */
+  if(parser->request_method != NULL)
+    parser->request_method(parser->data, buffer, method_end - buffer);
+  if(parser->request_path != NULL)
+    parser->request_path(parser->data, uri, path_end - uri);
+  if(query && parser->query_string != NULL)
+    parser->query_string(parser->data, query, target_end - query);
+  if(parser->request_uri != NULL)
+    parser->request_uri(parser->data, uri, target_end - uri);
+  if(frag && parser->fragment != NULL)
+    parser->fragment(parser->data, frag, uri_end - frag);
+  if(parser->http_version != NULL)
+    parser->http_version(parser->data, version, 8);
+  for(i = 0; i < nfields; ++i) {
+    if(parser->http_field != NULL)
+      parser->http_field(parser->data, fields[i].field, fields[i].flen, fields[i].value, fields[i].vlen);
+  }
+
+  parser->cs = http_parser_first_final;
+  parser->body_start = p - buffer;
+  parser->nread = p - buffer;
+  if(parser->header_done != NULL)
+    parser->header_done(parser->data, p, pe - p);
+  return 1;
+}
+
+
 int http_parser_init(http_parser *parser) {
   int cs = 0;
   %% write init;
@@ -271,6 +426,7 @@ int http_parser_init(http_parser *parser) {
   parser->field_start = 0;
   parser->xml_sent = 0;
   parser->json_sent = 0;
+  parser->fast_scan = 1;
 
   return(1);
 }
@@ -280,10 +436,16 @@ int http_parser_init(http_parser *parser) {
 size_t http_parser_execute(http_parser *parser, const char *buffer, size_t len, size_t off)  
 {
   if(len == 0) return 0;
-  parser->nread = 0;
-  parser->mark = 0;
-  parser->field_len = 0;
-  parser->field_start = 0;
+  if(off == 0) {
+    // off > 0 means resuming on the same (grown) buffer, keep the marks
+    parser->nread = 0;
+    parser->mark = 0;
+    parser->field_len = 0;
+    parser->field_start = 0;
+    if(parser->fast_scan && http_parser_execute_fast(parser, buffer, len)) {
+      return parser->nread;
+    }
+  }
  
   const char *p, *pe;
   int cs = parser->cs;
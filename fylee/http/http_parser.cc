@@ -1,6 +1,7 @@
 #include "http_parser.h"
 #include "fylee/log.h"
 #include "fylee/config.h"
+#include "fylee/object_pool.h"
 #include <string.h>
 
 namespace fylee {
@@ -24,10 +25,15 @@ static fylee::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
     fylee::Config::Lookup("http.response.max_body_size", 
                 (uint64_t)(64 * 1024 * 1024), "http response max body size"); // 64M
 
+static fylee::ConfigVar<bool>::ptr g_http_request_fast_scan =
+    fylee::Config::Lookup("http.request.fast_scan", 
+                true, "http request parser simd fast path");
+
 static uint64_t s_http_request_buffer_size = 0;
 static uint64_t s_http_request_max_body_size = 0;
 static uint64_t s_http_response_buffer_size = 0;
 static uint64_t s_http_response_max_body_size = 0;
+static bool s_http_request_fast_scan = true;
 
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
     return s_http_request_buffer_size;
@@ -53,6 +59,7 @@ struct _RequestSizeIniter {
         s_http_request_max_body_size = g_http_request_max_body_size->getValue();
         s_http_response_buffer_size = g_http_response_buffer_size->getValue();
         s_http_response_max_body_size = g_http_response_max_body_size->getValue();
+        s_http_request_fast_scan = g_http_request_fast_scan->getValue();
 
         g_http_request_buffer_size->addListener(
                 [](const uint64_t& old_val, const uint64_t& new_val){
@@ -73,6 +80,11 @@ struct _RequestSizeIniter {
                 [](const uint64_t& old_val, const uint64_t& new_val){
                 s_http_response_max_body_size = new_val;
         });
+
+        g_http_request_fast_scan->addListener(
+                [](const bool& old_val, const bool& new_val){
+                s_http_request_fast_scan = new_val;
+        });
     }
 };
 static _RequestSizeIniter _init;
@@ -138,14 +150,21 @@ void on_request_http_field(void *data, const char *field, size_t flen,
         //parser->setError(1002);
         return;
     }
-    parser->getData()->setHeader(std::string(field, flen), 
-                                 std::string(value, vlen));
+    if(parser->getBase()) {
+        parser->getData()->getHeaders().addSlice(parser->getBase(),
+                                                 field, flen, value, vlen);
+    } else {
+        parser->getData()->setHeader(std::string(field, flen), 
+                                     std::string(value, vlen));
+    }
 }
 
 HttpRequestParser::HttpRequestParser()
-    :error_(0) {
-    data_.reset(new fylee::http::HttpRequest);
+    :error_(0),
+     base_(nullptr) {
+    data_ = ObjectPool<HttpRequest>::Get();
     http_parser_init(&parser_);
+    parser_.fast_scan = s_http_request_fast_scan;
     parser_.request_method = on_request_method;
     parser_.request_uri = on_request_uri;
     parser_.fragment = on_request_fragment;
@@ -157,6 +176,15 @@ HttpRequestParser::HttpRequestParser()
     parser_.data = this;
 }
 
+void HttpRequestParser::reset() {
+    error_ = 0;
+    base_ = nullptr;
+    data_ = ObjectPool<HttpRequest>::Get();
+    // http_parser_init 不会修改回调和 data 指针
+    http_parser_init(&parser_);
+    parser_.fast_scan = s_http_request_fast_scan;
+}
+
 uint64_t HttpRequestParser::getContentLength() {
     return data_->getHeaderAs<uint64_t>("content-length", 0);
 }
@@ -165,11 +193,18 @@ uint64_t HttpRequestParser::getContentLength() {
 //-1: 有错误
 //>0: 已处理的字节数，且data有效数据为len - v;
 size_t HttpRequestParser::execute(char* data, size_t len) {
+    base_ = nullptr;
     size_t offset = http_parser_execute(&parser_, data, len, 0);
     memmove(data, data + offset, (len - offset));
     return offset;
 }
 
+size_t HttpRequestParser::execute(const char* data, size_t len, size_t off) {
+    // 续解析时缓冲可能已重新分配, 每次都更新起始地址, 已记录的偏移仍然有效
+    base_ = data;
+    return http_parser_execute(&parser_, data, len, off);
+}
+
 int HttpRequestParser::isFinished() {
     return http_parser_finish(&parser_);
 }
@@ -14,8 +14,29 @@ public:
 
     HttpRequestParser();
 
+    /**
+     * @brief 重置解析状态并从对象池取一个新的请求对象, 以便同一解析器解析下一个请求
+     */
+    void reset();
+
     size_t execute(char* data, size_t len);
 
+    /**
+     * @brief 在同一块(可增长的)连续内存上断点续解析
+     * @param[in] data 从请求起始位置开始的数据
+     * @param[in] len 数据总长度
+     * @param[in] off 上次已解析到的位置
+     * @return 从请求起始位置累计已解析的字节数
+     * @attention 头部只以相对 data 的切片记录, 解析完成后调用方须把这块内存
+     *            交给 getData()->getHeaders().adopt()
+     */
+    size_t execute(const char* data, size_t len, size_t off);
+
+    /**
+     * @brief 切片模式下当前数据的起始地址, 否则为 nullptr
+     */
+    const char* getBase() const { return base_;}
+
     int isFinished();
 
     int hasError(); 
@@ -36,6 +57,8 @@ private:
     http_parser parser_;
     HttpRequest::ptr data_;
     int error_;
+    /// 切片模式下数据起始地址
+    const char* base_;
 };
 
 class HttpResponseParser {
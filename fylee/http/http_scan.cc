@@ -0,0 +1,93 @@
+#include "http_scan.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FYLEE_HTTP_SCAN_X86 1
+#endif
+
+namespace fylee {
+namespace http {
+
+typedef const char* (*ScanFunc)(const char* begin, const char* end, bool space);
+
+const char* FindControlScalar(const char* begin, const char* end, bool space) {
+    const unsigned char limit = space ? 0x20 : 0x1f;
+    for(const char* p = begin; p < end; ++p) {
+        unsigned char c = *p;
+        if(c <= limit || c == 0x7f) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef FYLEE_HTTP_SCAN_X86
+__attribute__((target("sse2")))
+static const char* FindControlSSE2(const char* begin, const char* end, bool space) {
+    const __m128i limit = _mm_set1_epi8(space ? 0x21 : 0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const char* p = begin;
+    while(end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // 有符号比较时 >= 0x80 的字节也会小于 limit, 用各字节最高位把它们去掉
+        uint32_t mask = (_mm_movemask_epi8(_mm_cmplt_epi8(v, limit))
+                        & ~_mm_movemask_epi8(v))
+                      | _mm_movemask_epi8(_mm_cmpeq_epi8(v, del));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return FindControlScalar(p, end, space);
+}
+
+__attribute__((target("avx2")))
+static const char* FindControlAVX2(const char* begin, const char* end, bool space) {
+    const __m256i limit = _mm256_set1_epi8(space ? 0x21 : 0x20);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const char* p = begin;
+    while(end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = ((uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, v))
+                        & ~(uint32_t)_mm256_movemask_epi8(v))
+                      | (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, del));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return FindControlSSE2(p, end, space);
+}
+#endif
+
+static const char* s_scan_name = "scalar";
+
+static ScanFunc SelectScanFunc() {
+#ifdef FYLEE_HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        s_scan_name = "avx2";
+        return FindControlAVX2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        s_scan_name = "sse2";
+        return FindControlSSE2;
+    }
+#endif
+    s_scan_name = "scalar";
+    return FindControlScalar;
+}
+
+static ScanFunc s_scan_func = SelectScanFunc();
+
+const char* FindControl(const char* begin, const char* end, bool space) {
+    return s_scan_func(begin, end, space);
+}
+
+const char* GetScanImplName() {
+    return s_scan_name;
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#ifndef __FYLEE_HTTP_SCAN_H__
+#define __FYLEE_HTTP_SCAN_H__
+
+#include <stddef.h>
+
+namespace fylee {
+namespace http {
+
+/**
+ * @brief 查找 [begin, end) 中第一个控制字符(0x00-0x1f, 0x7f)
+ * @details 按 CPU 支持情况在运行时选择 AVX2/SSE2/标量实现, 用于快速定位 CRLF 等行边界
+ * @param[in] begin 起始位置
+ * @param[in] end 结束位置
+ * @param[in] space 为 true 时空格也当作边界
+ * @return 找到返回其位置, 否则返回 end
+ */
+const char* FindControl(const char* begin, const char* end, bool space = false);
+
+/**
+ * @brief 标量实现, 用于校验和基准对比
+ */
+const char* FindControlScalar(const char* begin, const char* end, bool space = false);
+
+/**
+ * @brief 当前使用的实现名称(avx2/sse2/scalar)
+ */
+const char* GetScanImplName();
+
+}
+}
+
+#endif
@@ -1,3 +1,4 @@
+#include <time.h>
 #include "http_server.h"
 #include "http_session.h"
 #include "fylee/socket.h"
@@ -5,6 +6,9 @@
 #include "fylee/log.h"
 #include "fylee/macro.h"
 #include "fylee/connection.h"
+#include "fylee/eventloop.h"
+#include "fylee/config.h"
+#include "fylee/object_pool.h"
 
 namespace fylee {
 namespace http {
@@ -12,10 +16,66 @@ using namespace std::placeholders;
 
 static fylee::Logger::ptr g_logger = LOG_NAME("system");
 
+static fylee::ConfigVar<uint32_t>::ptr g_http_keepalive_max_requests =
+    fylee::Config::Lookup("http.keepalive.max_requests", 
+                (uint32_t)1000, "http keepalive max requests per connection");
+
+static fylee::ConfigVar<uint64_t>::ptr g_http_keepalive_idle_ms =
+    fylee::Config::Lookup("http.keepalive.idle_ms", 
+                (uint64_t)(15 * 1000), "http keepalive idle timeout ms"); // 15s
+
+static const std::string s_server_key = "Server";
+
+static uint32_t s_http_keepalive_max_requests = 0;
+static uint64_t s_http_keepalive_idle_ms = 0;
+
+namespace {
+struct _KeepaliveIniter {
+    _KeepaliveIniter() {
+        s_http_keepalive_max_requests = g_http_keepalive_max_requests->getValue();
+        s_http_keepalive_idle_ms = g_http_keepalive_idle_ms->getValue();
+
+        g_http_keepalive_max_requests->addListener(
+                [](const uint32_t& old_val, const uint32_t& new_val){
+                s_http_keepalive_max_requests = new_val;
+        });
+
+        g_http_keepalive_idle_ms->addListener(
+                [](const uint64_t& old_val, const uint64_t& new_val){
+                s_http_keepalive_idle_ms = new_val;
+        });
+    }
+};
+static _KeepaliveIniter _init;
+}
+
+/// 每个 IO 线程缓存一份 "Date: ...\r\n", 由所在 EventLoop 每秒刷新一次
+static thread_local std::string* t_date_header = nullptr;
+
+static void UpdateDateHeader() {
+    char buf[64];
+    time_t now = time(0);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    size_t n = strftime(buf, sizeof(buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    t_date_header->assign(buf, n);
+}
+
+static const std::string& GetDateHeader(EventLoop* loop) {
+    if(!t_date_header) {
+        // 线程内只创建一次, 随 IO 线程存活, 不做释放
+        t_date_header = new std::string;
+        UpdateDateHeader();
+        loop->runEvery(1000, &UpdateDateHeader);
+    }
+    return *t_date_header;
+}
+
 HttpServer::HttpServer(EventLoop* loop, 
     const Address::ptr addr, bool keepalive, int threads) 
     :TcpServer(loop, addr, "HttpServer"), 
-    isKeepalive_(keepalive) {
+    isKeepalive_(keepalive),
+    serverHeader_("Server: " + getName() + "\r\n") {
     dispatch_.reset(new ServletDispatch);
     setConnectionCallback(
         std::bind(&HttpServer::onConnection, this, _1));
@@ -26,13 +86,83 @@ HttpServer::HttpServer(EventLoop* loop,
 
 void HttpServer::setName(const std::string& name) {
     TcpServer::setName(name);
+    serverHeader_ = "Server: " + name + "\r\n";
     dispatch_->setDefault(std::make_shared<NotFoundServlet>(name));
-
 }
 
 void HttpServer::onConnection(const Connection::ptr conn) {
+    HttpSession::ptr session = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
     if (conn->isConnected()) {
         LOG_INFO(g_logger) << "connection: " << conn->getName() << "established. ";
+        session->setConnection(conn);
+        session->setHeaderCallback(std::bind(&HttpServer::onRequestHeader, this,
+                    std::weak_ptr<Connection>(conn), _1));
+        if(isKeepalive_ && s_http_keepalive_idle_ms > 0) {
+            session->setLastActive(conn->getLoop()->now());
+            std::weak_ptr<Connection> weak_conn(conn);
+            session->setIdleTimer(conn->getLoop()->runAfter(s_http_keepalive_idle_ms,
+                    std::bind(&HttpServer::onIdleTimeout, this, weak_conn)));
+        }
+    } else if(session->getIdleTimer()) {
+        conn->getLoop()->cancel(session->getIdleTimer());
+        session->setIdleTimer(nullptr);
+    }
+}
+
+void HttpServer::onIdleTimeout(std::weak_ptr<Connection> weak_conn) {
+    Connection::ptr conn = weak_conn.lock();
+    if(!conn || !conn->isConnected()) {
+        return;
+    }
+    HttpSession::ptr session = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
+    uint64_t idle = conn->getLoop()->now() - session->getLastActive();
+    if(session->isStreaming()) {
+        // 流式响应可能持续很久, 期间不算空闲
+        idle = 0;
+    }
+    if(idle >= s_http_keepalive_idle_ms) {
+        LOG_DEBUG(g_logger) << "keepalive connection " << conn->getName()
+            << " idle " << idle << "ms, close";
+        session->setIdleTimer(nullptr);
+        conn->forceClose();
+        return;
+    }
+    // 期间有过请求, 按剩余时间重新定时, 避免每个请求都增删定时器
+    session->setIdleTimer(conn->getLoop()->runAfter(s_http_keepalive_idle_ms - idle,
+            std::bind(&HttpServer::onIdleTimeout, this, weak_conn)));
+}
+
+void HttpServer::onRequestHeader(std::weak_ptr<Connection> weak_conn, HttpRequest::ptr req) {
+    if(!dispatch_->hasStreamServlet()) {
+        return;
+    }
+    Connection::ptr conn = weak_conn.lock();
+    if(!conn) {
+        return;
+    }
+    StreamServlet::ptr slt = std::dynamic_pointer_cast<StreamServlet>(
+            dispatch_->getMatchedServlet(req->getPath()));
+    if(!slt) {
+        return;
+    }
+    HttpSession::ptr session = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
+    session->setStreamServlet(slt);
+    session->setBodyCallback(std::bind(&StreamServlet::onBody, slt, req, _1, _2));
+    slt->onHeader(req, session);
+}
+
+void HttpServer::onStreamEnd(std::weak_ptr<Connection> weak_conn) {
+    Connection::ptr conn = weak_conn.lock();
+    if(!conn || !conn->isConnected()) {
+        return;
+    }
+    // 处理流式响应期间到达的流水线请求
+    Buffer::ptr in = conn->inputBuffer();
+    if(in->getReadSize() > 0) {
+        onMessage(conn, conn->getLoop()->now());
+        if(in->getReadSize() == 0) {
+            in->clear();
+        }
     }
 }
 
@@ -44,27 +174,88 @@ void HttpServer::onMessage(const Connection::ptr conn, uint64_t receiveTime) {
     auto client = conn->getSocket();
     LOG_DEBUG(g_logger) << "handleClient " << *client << " at time: " << receiveTime;
     HttpSession::ptr session = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
-    bool isErr = false;
-    do {
-        auto req = session->recvRequest();
+    if(!conn->isConnected()) {
+        // 已决定关闭连接, 丢弃后续数据
+        conn->inputBuffer()->clear();
+        return;
+    }
+    session->setLastActive(receiveTime);
+    if(session->getIdleTimer() && session->getIdleTimer()->isWheelTimer()) {
+        // 时间轮上重设只是换个槽, 每次收到数据都推迟空闲超时
+        conn->getLoop()->restartTimer(session->getIdleTimer(), s_http_keepalive_idle_ms);
+    }
+    if(session->isStreaming()) {
+        // 流式响应结束前不处理后续请求, 数据留在输入缓冲中, 结束后由 onStreamEnd 继续
+        return;
+    }
+    // 一次读到的数据中可能包含多个流水线请求, 依次处理并按序把响应攒到同一个
+    // Buffer 中, 最后一次 writev 发出
+    Buffer::ptr out;
+    bool close = false;
+    bool error = false;
+    while(!close) {
+        auto req = session->recvRequest(conn->inputBuffer());
         if(!req) {
-            isErr = true;
-            LOG_DEBUG(g_logger) << "recv http request fail, errno="
-                << errno << " errstr=" << strerror(errno)
-                << " cliet:" << *client << " keep_alive=" << isKeepalive_;
+            // 请求不完整时等待更多数据
+            error = session->hasError();
             break;
         }
-        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), req->isClose() || !isKeepalive_));
-        rsp->setHeader("Server", getName());
-        dispatch_->handle(req, rsp, session);
-        conn->send(rsp->toString());
-        if(!isKeepalive_ || req->isClose()) {
-            break;
+        close = !isKeepalive_ || req->isClose()
+            || session->incRequestCount() >= s_http_keepalive_max_requests;
+        HttpResponse::ptr rsp = ObjectPool<HttpResponse>::Get();
+        rsp->setVersion(req->getVersion());
+        rsp->setClose(close);
+        Servlet::ptr slt = session->getStreamServlet();
+        if(slt) {
+            // 请求体已经流式交给了同一个 StreamServlet
+            session->setStreamServlet(nullptr);
+            slt->handle(req, rsp, session);
+        } else {
+            dispatch_->handle(req, rsp, session);
         }
-    } while(true);
-    if(isErr) {
-        conn->forceClose();
-    } else {
+        close = close || rsp->isClose();
+        if(!out) {
+            out.reset(new Buffer);
+        }
+        // Servlet 自己设置了 Server 时以其为准
+        const std::string* presets[] = {&serverHeader_, &GetDateHeader(conn->getLoop())};
+        if(rsp->hasHeader(s_server_key)) {
+            rsp->dump(out, presets + 1, 1);
+        } else {
+            rsp->dump(out, presets, 2);
+        }
+        if(rsp->isStream()) {
+            // 先发出响应头和之前攒下的响应, 后续数据由 Servlet 通过 HttpSession 写出
+            out->setPosition(0);
+            conn->send(out);
+            out.reset();
+            std::weak_ptr<Connection> weak_conn(conn);
+            session->startStream(close, std::bind(&HttpServer::onStreamEnd, this, weak_conn));
+            if(session->isStreaming() || close) {
+                return;
+            }
+        }
+    }
+    if(error) {
+        LOG_DEBUG(g_logger) << "recv http request fail, cliet:" << *client
+            << " error=" << session->getError() << " keep_alive=" << isKeepalive_;
+        // 在已处理请求的响应之后回一个带状态行的错误响应, 发完再关闭
+        HttpResponse::ptr rsp = ObjectPool<HttpResponse>::Get();
+        HttpStatus status = (HttpStatus)session->getError();
+        rsp->setStatus(status);
+        rsp->setClose(true);
+        rsp->setBody(HttpStatusToString(status));
+        if(!out) {
+            out.reset(new Buffer);
+        }
+        const std::string* presets[] = {&serverHeader_, &GetDateHeader(conn->getLoop())};
+        rsp->dump(out, presets, 2);
+    }
+    if(out) {
+        out->setPosition(0);
+        conn->send(out);
+    }
+    if(error || close) {
         conn->shutdown();
     }
 }
@@ -27,9 +27,14 @@ private:
     bool isKeepalive_;
     // Servlet分发器
     ServletDispatch::ptr dispatch_;
+    // 预先渲染好的 "Server: name\r\n"
+    std::string serverHeader_;
     void onConnection(const std::shared_ptr<Connection> conn);
     void onMessage(const std::shared_ptr<Connection> conn, uint64_t receiveTime);
     void onWriteComplete(const std::shared_ptr<Connection> conn);
+    void onIdleTimeout(std::weak_ptr<Connection> weak_conn);
+    void onStreamEnd(std::weak_ptr<Connection> weak_conn);
+    void onRequestHeader(std::weak_ptr<Connection> weak_conn, HttpRequest::ptr req);
 };
 
 }
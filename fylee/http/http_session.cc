@@ -1,11 +1,377 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "fylee/connection.h"
+#include "fylee/eventloop.h"
+#include <string.h>
 
 namespace fylee {
 namespace http {
 
 HttpSession::HttpSession(Socket::ptr sock, bool owner)
-    :SocketStream(sock, owner) {
+    :SocketStream(sock, owner),
+     state_(kExpectHeader),
+     bodyLength_(0),
+     trailerLines_(0),
+     error_(0),
+     requestCount_(0),
+     lastActive_(0),
+     streaming_(false),
+     streamStarted_(false),
+     streamEnded_(false),
+     streamChunked_(false),
+     streamClose_(false) {
+}
+
+void HttpSession::resetParser() {
+    state_ = kExpectHeader;
+    // 解析器随会话复用, 请求对象由线程局部对象池回收
+    if(parser_) {
+        parser_->reset();
+    }
+    header_.clear();
+    body_.clear();
+    bodyLength_ = 0;
+    bodyCb_ = nullptr;
+}
+
+size_t HttpSession::consumeBody(Buffer::ptr buf, size_t len) {
+    len = std::min<size_t>(len, buf->getReadSize());
+    if(len == 0) {
+        return 0;
+    }
+    if(!bodyCb_) {
+        size_t old = body_.size();
+        body_.resize(old + len);
+        buf->read(&body_[old], len);
+        return len;
+    }
+    // 流式接收: 暂停读取期间数据留在输入缓冲中, 恢复后再交给回调
+    Connection::ptr conn = conn_.lock();
+    if(conn && !conn->isReading()) {
+        return 0;
+    }
+    std::vector<iovec> iovs;
+    buf->getReadBuffers(iovs, len);
+    buf->setPosition(buf->getPosition() + len);
+    for(auto& i : iovs) {
+        bodyCb_(static_cast<const char*>(i.iov_base), i.iov_len);
+    }
+    return len;
+}
+
+/**
+ * @brief 解析 chunk-size [BWS] [; chunk-ext]
+ * @details 只接受 1*HEXDIG 开头, 不像 strtoull 那样跳过空白、接受正负号和 0x 前缀,
+ *          以免与前端代理对分块边界的理解不一致; 最多 16 位, 不会溢出
+ */
+static bool ParseChunkSize(const std::string& line, uint64_t& size) {
+    static const size_t kMaxDigits = 16;
+    size = 0;
+    size_t i = 0;
+    for(; i < line.size(); ++i) {
+        char c = line[i];
+        int v;
+        if(c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if(c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else if(c >= 'A' && c <= 'F') {
+            v = c - 'A' + 10;
+        } else {
+            break;
+        }
+        if(i == kMaxDigits) {
+            return false;
+        }
+        size = (size << 4) | v;
+    }
+    if(i == 0) {
+        return false;
+    }
+    return i == line.size() || line[i] == ';' || line[i] == ' ' || line[i] == '\t';
+}
+
+int HttpSession::readLine(Buffer::ptr buf, std::string& line) {
+    // 分块大小行和尾部字段都很短, 最多向后看 kMaxLineSize 字节;
+    // 在内存块中直接找换行, 只拷贝这一行
+    static const size_t kMaxLineSize = 4096;
+    size_t n = std::min<size_t>(buf->getReadSize(), kMaxLineSize);
+    int64_t pos = buf->find('\n', n);
+    if(pos < 0) {
+        line.clear();
+        return n >= kMaxLineSize ? -1 : 0;
+    }
+    line.resize(pos);
+    if(pos > 0) {
+        buf->read(&line[0], pos, buf->getPosition());
+    }
+    buf->setPosition(buf->getPosition() + pos + 1);
+    if(!line.empty() && line[line.size() - 1] == '\r') {
+        line.resize(line.size() - 1);
+    }
+    return 1;
+}
+
+bool HttpSession::recvChunkedBody(Buffer::ptr buf) {
+    std::string line;
+    while(true) {
+        switch(state_) {
+            case kExpectChunkSize: {
+                int rt = readLine(buf, line);
+                if(rt <= 0) {
+                    if(rt < 0) {
+                        error_ = 400;
+                    }
+                    return false;
+                }
+                uint64_t size = 0;
+                if(!ParseChunkSize(line, size)) {
+                    error_ = 400;
+                    return false;
+                }
+                if(!bodyCb_ && size > HttpRequestParser::GetHttpRequestMaxBodySize() - body_.size()) {
+                    error_ = 413;
+                    return false;
+                }
+                if(size == 0) {
+                    state_ = kExpectTrailer;
+                    trailerLines_ = 0;
+                } else {
+                    bodyLength_ = size;
+                    state_ = kExpectChunkData;
+                }
+                break;
+            }
+            case kExpectChunkData: {
+                // 已到达的部分直接消费掉, 不在输入缓冲里攒整个分块
+                bodyLength_ -= consumeBody(buf, bodyLength_);
+                if(bodyLength_ > 0) {
+                    return false;
+                }
+                state_ = kExpectChunkEnd;
+                break;
+            }
+            case kExpectChunkEnd: {
+                int rt = readLine(buf, line);
+                if(rt <= 0 || !line.empty()) {
+                    if(rt != 0) {
+                        error_ = 400;
+                    }
+                    return false;
+                }
+                state_ = kExpectChunkSize;
+                break;
+            }
+            case kExpectTrailer: {
+                // 忽略尾部字段, 空行结束
+                int rt = readLine(buf, line);
+                if(rt <= 0) {
+                    if(rt < 0) {
+                        error_ = 400;
+                    }
+                    return false;
+                }
+                if(line.empty()) {
+                    return true;
+                }
+                if(++trailerLines_ > kMaxTrailerLines) {
+                    error_ = 431;
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+HttpRequest::ptr HttpSession::recvRequest(Buffer::ptr buf) {
+    if(error_) {
+        return nullptr;
+    }
+    if(state_ == kExpectHeader) {
+        if(!parser_) {
+            parser_.reset(new HttpRequestParser);
+        }
+        size_t readable = buf->getReadSize();
+        size_t staged = header_.size();
+        if(readable <= staged) {
+            return nullptr;
+        }
+        uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
+        size_t n = std::min<size_t>(readable - staged, buff_size - staged);
+        header_.resize(staged + n);
+        buf->read(&header_[staged], n, buf->getPosition() + staged);
+
+        size_t nparse = parser_->execute(header_.data(), header_.size(), staged);
+        if(parser_->hasError()) {
+            error_ = 400;
+            return nullptr;
+        }
+        if(!parser_->isFinished()) {
+            if(header_.size() >= buff_size) {
+                error_ = 431;
+            }
+            return nullptr;
+        }
+        buf->setPosition(buf->getPosition() + nparse);
+        // 头部切片指向 header_, 直接交给请求对象, 换回其已清空的存储
+        parser_->getData()->getHeaders().adopt(header_);
+
+        if(headerCb_) {
+            headerCb_(parser_->getData());
+        }
+
+        std::string te = parser_->getData()->getHeader("transfer-encoding");
+        if(!te.empty()) {
+            // 只支持 chunked, 此时忽略 content-length
+            if(strcasecmp(te.c_str(), "chunked") != 0) {
+                error_ = 501;
+                return nullptr;
+            }
+            state_ = kExpectChunkSize;
+        } else {
+            bodyLength_ = parser_->getContentLength();
+            if(!bodyCb_ && bodyLength_ > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+                error_ = 413;
+                return nullptr;
+            }
+            state_ = kExpectBody;
+        }
+    }
+
+    HttpRequest::ptr req = parser_->getData();
+    if(state_ == kExpectBody) {
+        if(bodyCb_) {
+            bodyLength_ -= consumeBody(buf, bodyLength_);
+            if(bodyLength_ > 0) {
+                return nullptr;
+            }
+        } else {
+            if(buf->getReadSize() < bodyLength_) {
+                return nullptr;
+            }
+            consumeBody(buf, bodyLength_);
+        }
+    } else if(!recvChunkedBody(buf)) {
+        return nullptr;
+    }
+    if(!body_.empty()) {
+        req->setBody(std::move(body_));
+    }
+    req->init();
+    resetParser();
+    return req;
+}
+
+static void AppendChunk(Buffer::ptr buf, const std::string& data, bool chunked) {
+    if(chunked) {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "%zx\r\n", data.size());
+        buf->write(line, n);
+        buf->write(data.c_str(), data.size());
+        buf->write("\r\n", 2);
+    } else {
+        buf->write(data.c_str(), data.size());
+    }
+}
+
+void HttpSession::beginChunked(HttpResponse::ptr rsp) {
+    rsp->setStream(true);
+    streaming_ = true;
+    streamStarted_ = false;
+    streamEnded_ = false;
+    streamChunked_ = rsp->getVersion() >= 0x11;
+    if(!streamChunked_) {
+        rsp->setClose(true);
+    }
+}
+
+void HttpSession::writeChunk(const std::string& data) {
+    // 长度为 0 的块是结束标记
+    if(data.empty()) {
+        return;
+    }
+    Connection::ptr conn = conn_.lock();
+    if(!conn) {
+        return;
+    }
+    HttpSession::ptr self = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
+    conn->getLoop()->runInLoop(std::bind(&HttpSession::writeChunkInLoop, self, data));
+}
+
+void HttpSession::endChunked() {
+    Connection::ptr conn = conn_.lock();
+    if(!conn) {
+        return;
+    }
+    HttpSession::ptr self = std::dynamic_pointer_cast<HttpSession>(conn->getStream());
+    conn->getLoop()->runInLoop(std::bind(&HttpSession::endChunkedInLoop, self));
+}
+
+void HttpSession::writeChunkInLoop(const std::string& data) {
+    if(!streaming_ || streamEnded_) {
+        return;
+    }
+    if(!streamStarted_) {
+        if(!streamPending_) {
+            streamPending_.reset(new Buffer);
+        }
+        AppendChunk(streamPending_, data, streamChunked_);
+        return;
+    }
+    Connection::ptr conn = conn_.lock();
+    if(!conn) {
+        return;
+    }
+    Buffer::ptr out(new Buffer);
+    AppendChunk(out, data, streamChunked_);
+    out->setPosition(0);
+    conn->send(out);
+}
+
+void HttpSession::endChunkedInLoop() {
+    if(!streaming_ || streamEnded_) {
+        return;
+    }
+    streamEnded_ = true;
+    if(streamStarted_) {
+        finishStream();
+    }
+}
+
+void HttpSession::startStream(bool close, std::function<void()> cb) {
+    streamStarted_ = true;
+    streamClose_ = close || !streamChunked_;
+    streamEndCb_ = cb;
+    Connection::ptr conn = conn_.lock();
+    if(conn && streamPending_) {
+        streamPending_->setPosition(0);
+        conn->send(streamPending_);
+    }
+    streamPending_.reset();
+    if(streamEnded_) {
+        finishStream();
+    }
+}
+
+void HttpSession::finishStream() {
+    streaming_ = false;
+    std::function<void()> cb;
+    cb.swap(streamEndCb_);
+    Connection::ptr conn = conn_.lock();
+    if(!conn) {
+        return;
+    }
+    if(streamChunked_) {
+        conn->send("0\r\n\r\n", 5);
+    }
+    if(streamClose_) {
+        conn->shutdown();
+    } else if(cb) {
+        conn->getLoop()->queueInLoop(cb);
+    }
 }
 
 HttpRequest::ptr HttpSession::recvRequest() {
@@ -1,23 +1,206 @@
 #ifndef __FYLEE_HTTP_SESSION_H__
 #define __FYLEE_HTTP_SESSION_H__
 
+#include <functional>
 #include "fylee/socket_stream.h"
+#include "fylee/timer.h"
 #include "http.h"
+#include "http_parser.h"
 
 namespace fylee {
+class Connection;
 namespace http {
+class Servlet;
 
 class HttpSession : public SocketStream {
 public:
     typedef std::shared_ptr<HttpSession> ptr;
+    /// 请求头解析完成回调
+    typedef std::function<void(HttpRequest::ptr request)> HeaderCallback;
+    /// 请求体数据回调, 数据只在回调期间有效
+    typedef std::function<void(const char* data, size_t len)> BodyCallback;
 
     HttpSession(Socket::ptr sock, bool owner = true);
 
     HttpRequest::ptr recvRequest();
 
+    /**
+     * @brief 从连接的输入缓冲区中增量解析HTTP请求
+     * @param[in] buf 连接输入缓冲区, 请求完整时消费掉该请求占用的字节
+     * @return 请求完整时返回请求, 数据不足或出错返回nullptr(出错时hasError()为true)
+     */
+    HttpRequest::ptr recvRequest(Buffer::ptr buf);
+
+    /**
+     * @brief 增量解析是否出错
+     */
+    bool hasError() const { return error_ != 0;}
+
+    /**
+     * @brief 出错时应答的状态码(400/413/431/501), 未出错为 0
+     */
+    int getError() const { return error_;}
+
     HttpRequest::ptr parseRequest(std::string msg);
 
     int sendResponse(HttpResponse::ptr rsp);
+
+    /**
+     * @brief 该连接上已处理的请求数(keep-alive)
+     */
+    uint32_t getRequestCount() const { return requestCount_;}
+
+    uint32_t incRequestCount() { return ++requestCount_;}
+
+    /**
+     * @brief 最近一次收到数据的时间, EventLoop::now() 的单调时钟毫秒数
+     */
+    uint64_t getLastActive() const { return lastActive_;}
+
+    void setLastActive(uint64_t v) { lastActive_ = v;}
+
+    /**
+     * @brief keep-alive空闲超时定时器
+     */
+    Timer::ptr getIdleTimer() const { return idleTimer_;}
+
+    void setIdleTimer(Timer::ptr v) { idleTimer_ = v;}
+
+    /**
+     * @brief 设置所属连接, 由 HttpServer 在连接建立时设置
+     */
+    void setConnection(std::weak_ptr<Connection> v) { conn_ = v;}
+
+    std::shared_ptr<Connection> getConnection() const { return conn_.lock();}
+
+    /**
+     * @brief 每个请求的请求头解析完成后回调, 可在其中 setBodyCallback
+     */
+    void setHeaderCallback(HeaderCallback cb) { headerCb_ = cb;}
+
+    /**
+     * @brief 设置当前请求的请求体回调, 设置后请求体按到达的片段交给回调而不是缓存,
+     *        连接暂停读取(Connection::stopRead)时停止回调, 请求结束后自动清除
+     */
+    void setBodyCallback(BodyCallback cb) { bodyCb_ = cb;}
+
+    /**
+     * @brief 当前请求对应的 StreamServlet, 由 HttpServer 在收到请求头时设置, 处理请求时取回
+     */
+    std::shared_ptr<Servlet> getStreamServlet() const { return streamServlet_;}
+
+    void setStreamServlet(std::shared_ptr<Servlet> v) { streamServlet_ = v;}
+
+    /**
+     * @brief 开始流式响应
+     * @details 只能在 Servlet::handle 中(IO 线程)调用. 响应头由 HttpServer 在 handle
+     *          返回后按请求顺序发出, 之后可在任意线程调用 writeChunk/endChunked,
+     *          数据按调用顺序发出. 流结束前不处理同一连接上后续的流水线请求.
+     *          HTTP/1.1 使用 chunked 编码, HTTP/1.0 直接发送数据并在结束时关闭连接.
+     */
+    void beginChunked(HttpResponse::ptr rsp);
+
+    /**
+     * @brief 发送一段流式响应数据, 空数据被忽略
+     */
+    void writeChunk(const std::string& data);
+
+    /**
+     * @brief 结束流式响应
+     */
+    void endChunked();
+
+    /**
+     * @brief 是否有尚未结束的流式响应(IO 线程)
+     */
+    bool isStreaming() const { return streaming_;}
+
+    /**
+     * @brief 响应头放入发送队列后由 HttpServer 调用, 发出此前缓存的数据
+     * @param[in] close 流结束后是否关闭连接
+     * @param[in] cb 流结束且连接保持时的回调, 用于继续处理后续请求
+     */
+    void startStream(bool close, std::function<void()> cb);
+private:
+    enum ParseState {
+        kExpectHeader,
+        kExpectBody,
+        /// 以下为 chunked 消息体
+        kExpectChunkSize,
+        kExpectChunkData,
+        kExpectChunkEnd,
+        kExpectTrailer
+    };
+
+    void resetParser();
+
+    /// 尾部字段的行数上限, 每行最长 4096 字节
+    static const uint32_t kMaxTrailerLines = 64;
+
+    void writeChunkInLoop(const std::string& data);
+    void endChunkedInLoop();
+    void finishStream();
+
+    /**
+     * @brief 从 buf 读取一行(去掉 CRLF)
+     * @return 1 读到一行, 0 数据不足, -1 行过长
+     */
+    int readLine(Buffer::ptr buf, std::string& line);
+
+    /**
+     * @brief 增量解码 chunked 消息体到 body_
+     * @return 消息体完整返回 true, 数据不足或出错(error_ 非 0)返回 false
+     */
+    bool recvChunkedBody(Buffer::ptr buf);
+
+    /**
+     * @brief 消费 buf 中最多 len 字节的请求体, 交给 bodyCb_ 或追加到 body_
+     * @return 消费的字节数, 连接暂停读取时为 0
+     */
+    size_t consumeBody(Buffer::ptr buf, size_t len);
+private:
+    /// 当前解析阶段
+    ParseState state_;
+    /// 当前请求的解析器
+    HttpRequestParser::ptr parser_;
+    /// 请求头暂存区, ragel需要连续内存
+    std::string header_;
+    /// 已收到的消息体
+    std::string body_;
+    /// 消息体(chunked 时为当前分块)剩余长度
+    uint64_t bodyLength_;
+    /// 已读到的尾部字段行数
+    uint32_t trailerLines_;
+    /// 解析错误
+    int error_;
+    /// 已处理的请求数
+    uint32_t requestCount_;
+    /// 最近一次收到数据的时间
+    uint64_t lastActive_;
+    /// 空闲超时定时器
+    Timer::ptr idleTimer_;
+    /// 所属连接
+    std::weak_ptr<Connection> conn_;
+    /// 流式响应未结束
+    bool streaming_;
+    /// 响应头已发出
+    bool streamStarted_;
+    /// endChunked 已调用
+    bool streamEnded_;
+    /// 是否使用 chunked 编码
+    bool streamChunked_;
+    /// 流结束后关闭连接
+    bool streamClose_;
+    /// 响应头发出前写入的数据
+    Buffer::ptr streamPending_;
+    /// 流结束回调
+    std::function<void()> streamEndCb_;
+    /// 请求头回调
+    HeaderCallback headerCb_;
+    /// 当前请求的请求体回调
+    BodyCallback bodyCb_;
+    /// 当前请求的 StreamServlet
+    std::shared_ptr<Servlet> streamServlet_;
 };
 
 }
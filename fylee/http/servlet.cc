@@ -18,7 +18,8 @@ int32_t FunctionServlet::handle(fylee::http::HttpRequest::ptr request,
 
 
 ServletDispatch::ServletDispatch()
-    :Servlet("ServletDispatch") {
+    :Servlet("ServletDispatch"),
+     hasStream_(false) {
     default_.reset(new NotFoundServlet("fylee/1.0")); // 默认not found servlet
 }
 
@@ -33,11 +34,17 @@ int32_t ServletDispatch::handle(fylee::http::HttpRequest::ptr request,
 }
 
 void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
+    if(std::dynamic_pointer_cast<StreamServlet>(slt)) {
+        hasStream_ = true;
+    }
     RWMutexType::WriteLock lock(mutex_);
     datas_[uri] = std::make_shared<HoldServletCreator>(slt);
 }
 
 void ServletDispatch::addServletCreator(const std::string& uri, IServletCreator::ptr creator) {
+    if(std::dynamic_pointer_cast<StreamServlet>(creator->get())) {
+        hasStream_ = true;
+    }
     RWMutexType::WriteLock lock(mutex_);
     datas_[uri] = creator;
 }
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <atomic>
 #include "http.h"
 #include "http_session.h"
 #include "fylee/thread.h"
@@ -49,6 +50,37 @@ private:
     Callback cb_;
 };
 
+/**
+ * @brief 流式接收请求体的 Servlet
+ * @details 收到请求头后调用 onHeader, 之后每收到一段请求体调用一次 onBody,
+ *          请求体不会缓存在 HttpRequest 中, 也不受 http.request.max_body_size 限制.
+ *          接收完毕后调用 handle 生成响应, 此时 request 的 body 为空.
+ *          处理不过来时可调用 session->getConnection()->stopRead() 暂停读取,
+ *          startRead() 恢复后从暂停处继续回调 onBody.
+ *          同一请求的回调都在连接所属的 IO 线程中执行, 且使用同一个 Servlet 对象.
+ */
+class StreamServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StreamServlet> ptr;
+
+    StreamServlet(const std::string& name)
+        :Servlet(name) {}
+
+    /**
+     * @brief 请求头接收完毕
+     */
+    virtual void onHeader(fylee::http::HttpRequest::ptr request,
+                          fylee::http::HttpSession::ptr session) {}
+
+    /**
+     * @brief 收到一段请求体
+     * @param[in] data 数据, 只在回调期间有效
+     * @param[in] len 数据长度
+     */
+    virtual void onBody(fylee::http::HttpRequest::ptr request,
+                        const char* data, size_t len) = 0;
+};
+
 class IServletCreator {
 public:
     typedef std::shared_ptr<IServletCreator> ptr;
@@ -125,11 +157,17 @@ public:
      
     Servlet::ptr getMatchedServlet(const std::string& uri);
 
+    /**
+     * @brief 是否注册过 StreamServlet, 没有时不必在收到请求头时查找
+     */
+    bool hasStreamServlet() const { return hasStream_;}
+
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
 private:
     RWMutexType mutex_;
     std::unordered_map<std::string, IServletCreator::ptr> datas_;
     Servlet::ptr default_;
+    std::atomic<bool> hasStream_;
 };
 
 class NotFoundServlet : public Servlet {
@@ -18,7 +18,7 @@
     if(logger->getLevel() <= level) \
         fylee::LogEventWrap(fylee::LogEvent::ptr(new fylee::LogEvent(logger, level, \
                         __FILE__, __LINE__, 0, fylee::GetThreadId(),\
-                fylee::GetCoroId(), time(0), fylee::Thread::GetName()))).getSS()
+                fylee::GetCoroId(), fylee::GetCachedTime(), fylee::Thread::GetName()))).getSS()
 
 #define LOG_DEBUG(logger) LOG_LEVEL(logger, fylee::LogLevel::DEBUG)
 
@@ -34,7 +34,7 @@
     if(logger->getLevel() <= level) \
         fylee::LogEventWrap(fylee::LogEvent::ptr(new fylee::LogEvent(logger, level, \
                         __FILE__, __LINE__, 0, fylee::GetThreadId(),\
-                fylee::GetCoroId(), time(0), fylee::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+                fylee::GetCoroId(), fylee::GetCachedTime(), fylee::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
 
 #define LOG_FMT_DEBUG(logger, fmt, ...) LOG_FMT_LEVEL(logger, fylee::LogLevel::DEBUG, fmt, __VA_ARGS__)
 
@@ -0,0 +1,119 @@
+#ifndef __FYLEE_MPSC_QUEUE_H__
+#define __FYLEE_MPSC_QUEUE_H__
+
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+#include "noncopyable.h"
+
+namespace fylee {
+
+/**
+ * @brief 无锁多生产者单消费者队列(Vyukov 侵入式链表)
+ * @details push 可在任意线程调用, 只有一次原子 exchange, 不加锁;
+ *          consume 只能由唯一的消费者线程(EventLoop 所在线程)调用.
+ *          生产者 exchange head_ 之后、链上 next 之前的短暂窗口内,
+ *          消费者会把队列看成到此为止, 调用方需要保证之后还会再消费一次.
+ *          T 需要可默认构造和移动.
+ */
+template<class T>
+class MpscQueue : Noncopyable {
+public:
+    MpscQueue()
+        :head_(&stub_),
+         tail_(&stub_),
+         size_(0) {
+    }
+
+    ~MpscQueue() {
+        T value;
+        while(pop(value)) {
+        }
+        if(tail_ != &stub_) {
+            delete tail_;
+        }
+    }
+
+    /**
+     * @brief 入队, 线程安全
+     */
+    void push(T&& value) {
+        Node* node = new Node(std::move(value));
+        size_.fetch_add(1, std::memory_order_relaxed);
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief 出队一个元素, 只能在消费者线程调用
+     * @return 队列为空(或生产者尚未链接完成)时返回 false
+     */
+    bool pop(T& value) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        advance(tail, next);
+        return true;
+    }
+
+    /**
+     * @brief 依次取出调用时已在队列中的元素并执行 cb, 只能在消费者线程调用
+     * @details cb 中再入队的元素留到下一次 consume, 避免自我重投的任务把消费者卡住
+     * @return 处理的元素个数
+     */
+    template<class Callback>
+    size_t consume(Callback cb) {
+        Node* last = head_.load(std::memory_order_acquire);
+        size_t n = 0;
+        while(tail_ != last) {
+            Node* tail = tail_;
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if(!next) {
+                break;
+            }
+            T value(std::move(next->value));
+            advance(tail, next);
+            ++n;
+            cb(value);
+        }
+        return n;
+    }
+
+    /**
+     * @brief 近似的元素个数, 可在任意线程读取
+     */
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+    bool empty() const { return size() == 0; }
+private:
+    struct Node {
+        Node() {}
+        explicit Node(T&& v) : value(std::move(v)) {}
+
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    /// next 成为新的哨兵节点, 释放旧的(stub_ 是成员, 不释放)
+    void advance(Node* tail, Node* next) {
+        tail_ = next;
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        if(tail != &stub_) {
+            delete tail;
+        }
+    }
+private:
+    // 生产者端, 最后入队的节点
+    std::atomic<Node*> head_;
+    // 消费者端, 哨兵节点, 它的 next 才是第一个有效元素
+    Node* tail_;
+    std::atomic<size_t> size_;
+    Node stub_;
+};
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef __FYLEE_OBJECT_POOL_H__
+#define __FYLEE_OBJECT_POOL_H__
+
+#include <memory>
+#include <vector>
+#include <stddef.h>
+
+namespace fylee {
+
+/**
+ * @brief 线程局部对象池
+ * @details 每个线程(即每个 EventLoop)各自缓存一批空闲对象, 不需要加锁.
+ *          Get() 返回的 shared_ptr 析构时, 对象调用 reset() 后放回当前线程的池中,
+ *          空闲数超过 MaxFree 或线程已退出时直接释放. shared_ptr 的控制块也从
+ *          线程局部的空闲链表分配, 稳定运行时 Get() 不再调用 malloc.
+ *          T 需要有默认构造函数和 void reset() 成员.
+ */
+template<class T, size_t MaxFree = 1024>
+class ObjectPool {
+public:
+    typedef std::shared_ptr<T> ptr;
+
+    /**
+     * @brief 取出一个对象, 池为空时新建
+     */
+    static ptr Get() {
+        T* obj = nullptr;
+        FreeList* list = GetFreeList();
+        if(list && !list->objs.empty()) {
+            obj = list->objs.back();
+            list->objs.pop_back();
+        } else {
+            obj = new T;
+        }
+        return ptr(obj, &ObjectPool::Release, BlockAllocator<T>());
+    }
+
+    /**
+     * @brief 当前线程池中空闲对象数
+     */
+    static size_t GetFreeCount() {
+        FreeList* list = GetFreeList();
+        return list ? list->objs.size() : 0;
+    }
+private:
+    /**
+     * @brief shared_ptr 控制块的分配器, 单个块放回线程局部的空闲链表
+     * @details 控制块在最后一个引用释放的线程归还, 放进该线程的链表; 各线程的块都来自
+     *          operator new, 可以互相复用
+     */
+    template<class U>
+    struct BlockAllocator {
+        typedef U value_type;
+
+        BlockAllocator() {}
+
+        template<class V>
+        BlockAllocator(const BlockAllocator<V>&) {}
+
+        U* allocate(size_t n) {
+            BlockList* list = n == 1 ? GetBlockList() : nullptr;
+            if(list && !list->blocks.empty()) {
+                void* p = list->blocks.back();
+                list->blocks.pop_back();
+                return static_cast<U*>(p);
+            }
+            return static_cast<U*>(::operator new(n * sizeof(U)));
+        }
+
+        void deallocate(U* p, size_t n) {
+            BlockList* list = n == 1 ? GetBlockList() : nullptr;
+            if(!list || list->blocks.size() >= MaxFree) {
+                ::operator delete(p);
+                return;
+            }
+            list->blocks.push_back(p);
+        }
+
+        template<class V>
+        bool operator==(const BlockAllocator<V>&) const { return true;}
+
+        template<class V>
+        bool operator!=(const BlockAllocator<V>&) const { return false;}
+    private:
+        struct BlockList {
+            std::vector<void*> blocks;
+
+            ~BlockList() {
+                for(auto& i : blocks) {
+                    ::operator delete(i);
+                }
+                Destroyed() = true;
+            }
+        };
+
+        static bool& Destroyed() {
+            static thread_local bool s_destroyed = false;
+            return s_destroyed;
+        }
+
+        static BlockList* GetBlockList() {
+            if(Destroyed()) {
+                return nullptr;
+            }
+            static thread_local BlockList s_list;
+            return &s_list;
+        }
+    };
+
+    struct FreeList {
+        std::vector<T*> objs;
+
+        ~FreeList() {
+            for(auto& i : objs) {
+                delete i;
+            }
+            Destroyed() = true;
+        }
+    };
+
+    /// 线程退出时 FreeList 可能先于持有对象的其它线程局部变量析构, 此后归还的对象直接释放
+    static bool& Destroyed() {
+        static thread_local bool s_destroyed = false;
+        return s_destroyed;
+    }
+
+    static FreeList* GetFreeList() {
+        if(Destroyed()) {
+            return nullptr;
+        }
+        static thread_local FreeList s_list;
+        return &s_list;
+    }
+
+    static void Release(T* obj) {
+        FreeList* list = GetFreeList();
+        if(!list || list->objs.size() >= MaxFree) {
+            delete obj;
+            return;
+        }
+        obj->reset();
+        list->objs.push_back(obj);
+    }
+};
+
+}
+
+#endif
@@ -1,140 +1,150 @@
 #include "poller.h"
+#include "epoll_poller.h"
+#include "uring_poller.h"
+#include "config.h"
+#include "env.h"
 #include "macro.h"
 #include "channel.h"
 #include "log.h"
+#include <algorithm>
+#include <sys/resource.h>
 
 namespace fylee {
 static fylee::Logger::ptr g_logger = LOG_NAME("system");
 
-template<typename To, typename From>
-inline To implicit_cast(From const &f) {
-    return f;
-}
+static fylee::ConfigVar<std::string>::ptr g_eventloop_poller =
+    fylee::Config::Lookup("eventloop.poller", std::string("epoll"),
+                "io multiplexing backend: epoll or io_uring, env FYLEE_POLLER overrides");
 
 bool Poller::hasChannel(Channel* channel) const {
     assertInLoopThread();
-    auto it = channels_.find(channel->getFd());
-    return it != channels_.end() && it->second == channel;
+    return findChannel(channel->getFd()) == channel;
 }
 
-Poller::Poller(EventLoop* loop) 
-    :ownerLoop_(loop),
-     epollfd_(epoll_create(8192)),
-     events_(kInitEventListSize) {
-    if (epollfd_ < 0) {
-        LOG_FATAL(g_logger) << "Create poll fd error.";
+// 按 RLIMIT_NOFILE 预留, fd 不会超过它; 上限很大时只预留一部分, 之后按需扩展
+static size_t InitChannelTableSize(size_t max) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        return std::min(static_cast<size_t>(rl.rlim_cur), max);
     }
+    return max;
 }
 
-Poller::~Poller() {
-    ::close(epollfd_);
+Poller::Poller(EventLoop* loop) 
+    :channels_(InitChannelTableSize(kMaxInitChannelTableSize), nullptr),
+     channelCount_(0),
+     ownerLoop_(loop),
+     epollCtls_(0),
+     epollCtlsAvoided_(0) {
 }
 
-uint64_t Poller::poll(int timeoutMs, ChannelList* activeChannels) {
-    LOG_INFO(g_logger) << "fd total count " << channels_.size();
-    int numEvents = ::epoll_wait(epollfd_,
-                                &*events_.begin(),
-                                static_cast<int>(events_.size()),
-                                timeoutMs);
-    int savedErrno = errno;
-    uint64_t now_ms = fylee::GetCurrentMS();
-    if (numEvents > 0) {
-        LOG_INFO(g_logger) << numEvents << " events happened";
-        fillActiveChannels(numEvents, activeChannels);
-        if (implicit_cast<size_t>(numEvents) == events_.size()) {
-            events_.resize(events_.size() * 2);
-        }
-    } else if (numEvents == 0) {
-        LOG_INFO(g_logger) << "nothing happened";
-    } else {
-        // error happens, log uncommon ones
-        if (savedErrno != EINTR) {
-            errno = savedErrno;
-            LOG_ERROR(g_logger) << "Poller::poll()";
-        }
-    }
-    return now_ms;
+Poller::~Poller() {
 }
 
-void Poller::fillActiveChannels(int numEvents, 
-                                ChannelList* activeChannels) const {
-    ASSERT(implicit_cast<size_t>(numEvents) <= events_.size());
-    for (int i = 0; i < numEvents; ++i) {
-        Channel* channel = static_cast<Channel*>(events_[i].data.ptr);
-    #ifndef NDEBUG
-        int fd = channel->getFd();
-        auto it = channels_.find(fd);
-        ASSERT(it != channels_.end());
-        ASSERT(it->second == channel);
-    #endif
-        channel->setRevents(events_[i].events);
-        activeChannels->push_back(channel);
+Poller* Poller::newDefaultPoller(EventLoop* loop) {
+    std::string name = fylee::EnvMgr::GetInstance()->getEnv("FYLEE_POLLER",
+            g_eventloop_poller->getValue());
+    if (name == "io_uring") {
+        std::unique_ptr<UringPoller> poller(new UringPoller(loop));
+        if (poller->isValid()) {
+            return poller.release();
+        }
+        LOG_WARN(g_logger) << "io_uring is not supported, fall back to epoll";
+    } else if (name != "epoll") {
+        LOG_WARN(g_logger) << "unknown poller " << name << ", use epoll";
     }
+    return new EPollPoller(loop);
 }
 
 void Poller::updateChannel(Channel* channel) {
     assertInLoopThread();
     const int index = channel->getIndex();
-    LOG_INFO(g_logger) << "fd = " << channel->getFd() 
+    LOG_DEBUG(g_logger) << "fd = " << channel->getFd() 
                        << " events = " << channel->getEvents() << " index = " << index;
     if (index == kNew || index == kDeleted) {
         // a new one, add with EPOLL_CTL_ADD
         int fd = channel->getFd();
         if (index == kNew) {
-            ASSERT(channels_.find(fd) == channels_.end());
+            ASSERT(fd >= 0);
+            if (static_cast<size_t>(fd) >= channels_.size()) {
+                channels_.resize(std::max(channels_.size() * 2, static_cast<size_t>(fd) + 1), nullptr);
+            }
+            ASSERT(channels_[fd] == nullptr);
             channels_[fd] = channel;
+            ++channelCount_;
         } else { // index == kDeleted
-            ASSERT(channels_.find(fd) != channels_.end());
-            ASSERT(channels_[fd] == channel);
+            ASSERT(findChannel(fd) == channel);
         }
 
         channel->setIndex(kAdded);
-        update(EPOLL_CTL_ADD, channel);
+        commit(EPOLL_CTL_ADD, channel);
     } else {
-        // update existing one with EPOLL_CTL_MOD/DEL
-        int fd = channel->getFd();
-        ASSERT(channels_.find(fd) != channels_.end());
-        ASSERT(channels_[fd] == channel);
+        // existing one, EPOLL_CTL_MOD/DEL deferred to flushUpdates
+        ASSERT(findChannel(channel->getFd()) == channel);
         ASSERT(index == kAdded);
-        if (channel->isNoneEvent()) {
-            update(EPOLL_CTL_DEL, channel);
+        if (channel->isUpdatePending()) {
+            epollCtlsAvoided_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            channel->setPendingIndex(static_cast<int>(pendingChannels_.size()));
+            pendingChannels_.push_back(channel);
+        }
+    }
+}
+
+void Poller::flushUpdates() {
+    assertInLoopThread();
+    for (auto channel : pendingChannels_) {
+        channel->setPendingIndex(-1);
+        if (channel->getEvents() == channel->getRegisteredEvents()) {
+            epollCtlsAvoided_.fetch_add(1, std::memory_order_relaxed);
+        } else if (channel->isNoneEvent()) {
+            commit(EPOLL_CTL_DEL, channel);
             channel->setIndex(kDeleted);
         } else {
-            update(EPOLL_CTL_MOD, channel);
+            commit(EPOLL_CTL_MOD, channel);
         }
     }
+    pendingChannels_.clear();
 }
 
 void Poller::removeChannel(Channel* channel) {
     assertInLoopThread();
     int fd = channel->getFd();
-    LOG_INFO(g_logger) << "fd = " << fd;
-    ASSERT(channels_.find(fd) != channels_.end());
-    ASSERT(channels_[fd] == channel);
+    LOG_DEBUG(g_logger) << "fd = " << fd;
+    ASSERT(findChannel(fd) == channel);
     ASSERT(channel->isNoneEvent());
     int index = channel->getIndex();
     ASSERT(index == kAdded || index == kDeleted);
-    size_t n = channels_.erase(fd);
-    ASSERT(n == 1);
+    channels_[fd] = nullptr;
+    --channelCount_;
+    if (channel->isUpdatePending()) {
+        // 用末尾的 Channel 填补空位, 批量关闭连接时不必逐个查找
+        int pos = channel->getPendingIndex();
+        Channel* last = pendingChannels_.back();
+        pendingChannels_[pos] = last;
+        last->setPendingIndex(pos);
+        pendingChannels_.pop_back();
+        channel->setPendingIndex(-1);
+    }
 
     if (index == kAdded) {
-        update(EPOLL_CTL_DEL, channel);
+        commit(EPOLL_CTL_DEL, channel);
     }
     channel->setIndex(kNew);
+    onRemove(channel);
 }
 
-void Poller::update(int operation, Channel* channel) {
-    struct epoll_event event;
-    bzero(&event, sizeof(event));
-    event.events = channel->getEvents();
-    event.data.ptr = channel;
-    int fd = channel->getFd();
-    LOG_INFO(g_logger) << "epoll_ctl op = " << operationToString(operation)
-                << " fd = " << fd << " event = { " << channel->eventsToString() << " }";
-    if (epoll_ctl(epollfd_, operation, fd, &event) < 0) {
-        LOG_ERROR(g_logger) << "epoll_ctl failed op =" 
-                << operationToString(operation) << " fd =" << fd;
-    }
+int Poller::takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+void Poller::commit(int operation, Channel* channel) {
+    LOG_DEBUG(g_logger) << getName() << " op = " << operationToString(operation)
+                << " fd = " << channel->getFd() << " event = { " << channel->eventsToString() << " }";
+    epollCtls_.fetch_add(1, std::memory_order_relaxed);
+    channel->setRegisteredEvents(operation == EPOLL_CTL_DEL ? 0 : channel->getEvents());
+    update(operation, channel);
 }
 
 const char* Poller::operationToString(int op) {
@@ -6,39 +6,110 @@
 #include <unistd.h>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <vector>
-#include <map>
 #include <functional>
 #include "eventloop.h"
 #include "noncopyable.h"
 
 namespace fylee {
 class Channel;
+class Buffer;
+
+/**
+ * @brief IO 多路复用的基类, 具体后端为 EPollPoller 和 UringPoller
+ * @details 新 Channel 立即注册; 已注册 Channel 的关注事件变化只记下来,
+ *          由 EventLoop 在下一次 poll 之前调用 flushUpdates() 统一提交,
+ *          同一轮内多次变化合并为一次提交, 与内核中的事件相同时不提交.
+ *          提交之前没有 poll, 内核看到的关注事件是连续的, 不影响边沿触发的语义.
+ *          后端通过 newDefaultPoller 按配置 eventloop.poller 或环境变量 FYLEE_POLLER 选择
+ */
 class Poller : Noncopyable {
 public:
     typedef std::shared_ptr<Poller> ptr;
     typedef std::vector<Channel*> ChannelList;
 
     Poller(EventLoop* loop);
-    ~Poller();
+    virtual ~Poller();
+
+    /**
+     * @brief 等待 IO 事件
+     * @param[in] timeoutMs 超时毫秒数, 0 立即返回, -1 一直等待;
+     *            不使用 timerfd 时由 EventLoop 按最近的定时器计算
+     * @param[out] activeChannels 有事件的 Channel
+     * @return 返回时的单调时钟毫秒数
+     */
+    virtual uint64_t poll(int timeoutMs, ChannelList* activeChannels) = 0;
 
-    uint64_t poll(int timeoutMs, ChannelList* activeChannels);
+    /**
+     * @brief 后端名称
+     */
+    virtual const char* getName() const = 0;
 
     void updateChannel(Channel* channel);
 
     void removeChannel(Channel* channel);
 
+    /**
+     * @brief 提交待更新 Channel 的关注事件, 在 poll 之前调用
+     */
+    void flushUpdates();
+
     bool hasChannel(Channel* channel) const;
 
+    /**
+     * @brief 准备完成模式接收, 返回是否支持; 默认不支持
+     */
+    virtual bool setupCompletionRecv() { return false; }
+
+    /**
+     * @brief 取出完成模式下 channel 已收到的数据, 追加到 buf 的当前位置
+     * @return 语义同 read: 返回字节数, 对端关闭返回 0, 没有数据时返回 -1 且 errno 为 EAGAIN
+     */
+    virtual int takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf);
+
+    /**
+     * @brief 按配置 eventloop.poller(环境变量 FYLEE_POLLER 优先)创建后端,
+     *        io_uring 不可用时退回 epoll
+     */
     static Poller* newDefaultPoller(EventLoop* loop);
 
     void assertInLoopThread() const {
         ownerLoop_->assertInLoopThread();
     }
 
+    /**
+     * @brief 注册的 Channel 个数
+     */
+    size_t channelCount() const { return channelCount_; }
+
+    /// 实际提交关注事件变化(epoll_ctl 或 io_uring poll 请求)的次数, 可在任意线程读取
+    uint64_t epollCtls() const { return epollCtls_.load(std::memory_order_relaxed); }
+    /// 省掉的提交次数, 可在任意线程读取
+    uint64_t epollCtlsAvoided() const { return epollCtlsAvoided_.load(std::memory_order_relaxed); }
+
 protected:
-    typedef std::map<int, Channel*> ChannelMap;
-    ChannelMap channels_;
+    /**
+     * @brief 把关注事件变化交给内核
+     * @param[in] operation EPOLL_CTL_ADD/MOD/DEL
+     */
+    virtual void update(int operation, Channel* channel) = 0;
+
+    /**
+     * @brief Channel 从表中移除后调用, 后端在此丢弃与它相关的状态
+     */
+    virtual void onRemove(Channel* channel) {}
+
+    static const char* operationToString(int op);
+
+    /// 以 fd 为下标的 Channel 表, 未注册的 fd 为 nullptr
+    typedef std::vector<Channel*> ChannelTable;
+    ChannelTable channels_;
+    size_t channelCount_;
+
+    Channel* findChannel(int fd) const {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd] : nullptr;
+    }
 
 private:
     enum EpollOp {
@@ -46,15 +117,16 @@ private:
         kAdded = 1,
         kDeleted = 2,
     };
-    typedef std::vector<struct epoll_event> EventList;
+    /// 计数、记录内核中的事件后调用 update
+    void commit(int operation, Channel* channel);
+
     EventLoop* ownerLoop_;
-    int epollfd_;
-    EventList events_;
-    static const int kInitEventListSize = 16;
-    static const char* operationToString(int op);
-    void fillActiveChannels(int numEvents,
-                            ChannelList* activeChannels) const;
-    void update(int operation, Channel* channel);
-};   
+    // 关注事件有变化、等待 flushUpdates 提交的 Channel
+    ChannelList pendingChannels_;
+    std::atomic<uint64_t> epollCtls_;
+    std::atomic<uint64_t> epollCtlsAvoided_;
+    /// Channel 表初始大小的上限, 超过后按需扩展
+    static const size_t kMaxInitChannelTableSize = 16384;
+};
 }
-#endif
\ No newline at end of file
+#endif
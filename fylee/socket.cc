@@ -120,6 +120,30 @@ bool Socket::setNonBlock() {
     if (fcntl(sockfd_, F_SETFL, flag) == -1) return false;
     return true;
 }
+
+bool Socket::setReusePort() {
+#ifdef SO_REUSEPORT
+    if(!isValid()) {
+        newSock();
+        if(UNLIKELY(!isValid())) {
+            return false;
+        }
+    }
+    int val = 1;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+#else
+    return false;
+#endif
+}
+
+bool Socket::setBusyPoll(int us) {
+#ifdef SO_BUSY_POLL
+    return setOption(SOL_SOCKET, SO_BUSY_POLL, us);
+#else
+    return false;
+#endif
+}
+
 Socket::ptr Socket::accept() {
     Socket::ptr sock(new Socket(family_, type_, protocol_));
     int newsock = ::accept(sockfd_, nullptr, nullptr);
@@ -134,6 +158,21 @@ Socket::ptr Socket::accept() {
     return nullptr;
 }
 
+Socket::ptr Socket::acceptNonBlock() {
+    int newsock = ::accept4(sockfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(newsock == -1) {
+        return nullptr;
+    }
+    Socket::ptr sock(new Socket(family_, type_, protocol_));
+    sock->sockfd_ = newsock;
+    sock->isConnected_ = true;
+    if(type_ == SOCK_STREAM) {
+        int val = 1;
+        sock->setOption(IPPROTO_TCP, TCP_NODELAY, val);
+    }
+    return sock;
+}
+
 bool Socket::init(int sock) {
     FdCtx::ptr ctx = FdMgr::GetInstance()->get(sock, true);
     if(ctx && ctx->isSocket() && !ctx->isClose()) {
@@ -238,6 +277,8 @@ bool Socket::close() {
     }
     isConnected_ = false;
     if(sockfd_ != -1) {
+        // fd会被复用, 丢掉旧的上下文, 保证新socket重新设置非阻塞
+        FdMgr::GetInstance()->del(sockfd_);
         ::close(sockfd_);
         sockfd_ = -1;
     }
@@ -70,9 +70,27 @@ public:
     }
 
     bool setNonBlock();
+
+    /**
+     * @brief 设置 SO_REUSEPORT, 需在 bind 之前调用, 套接字尚未创建时会先创建
+     */
+    bool setReusePort();
+
+    /**
+     * @brief 设置 SO_BUSY_POLL, 读这个套接字时在网卡队列上忙等 us 微秒
+     */
+    bool setBusyPoll(int us);
   
     virtual Socket::ptr accept();
 
+    /**
+     * @brief 用 accept4(SOCK_NONBLOCK | SOCK_CLOEXEC) 接收连接
+     * @details 不注册 FdCtx, 也不查询本端/对端地址, 地址在第一次
+     *          getLocalAddress()/getRemoteAddress() 时再获取.
+     *          失败返回 nullptr, 不打日志, errno 保留给调用方判断
+     */
+    Socket::ptr acceptNonBlock();
+
     virtual bool bind(const Address::ptr addr);
 
     virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1);
@@ -0,0 +1,159 @@
+#ifndef __FYLEE_TASK_H__
+#define __FYLEE_TASK_H__
+
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <stddef.h>
+
+namespace fylee {
+
+/**
+ * @brief 只能移动的 void() 任务, 用于 EventLoop 投递
+ * @details 可调用对象不超过 kInlineSize 字节且移动构造不抛异常时直接存放在内部缓冲区,
+ *          不分配内存; 否则退化为堆上存放. 典型的
+ *          std::bind(&X::f, shared_from_this(), std::string) 可以放进内部缓冲区.
+ *          可以从任意可调用对象(包括 std::function)隐式构造
+ */
+class Task {
+public:
+    /// 内部缓冲区大小
+    static const size_t kInlineSize = 80;
+
+    Task() : ops_(nullptr) {}
+
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f)
+        :ops_(nullptr) {
+        typedef typename std::decay<F>::type Func;
+        init<Func>(std::forward<F>(f), std::integral_constant<bool,
+                sizeof(Func) <= kInlineSize
+                && alignof(Func) <= alignof(Storage)
+                && std::is_nothrow_move_constructible<Func>::value>());
+    }
+
+    Task(Task&& other) noexcept
+        :ops_(nullptr) {
+        moveFrom(other);
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    void operator()() {
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    /**
+     * @brief 可调用对象是否存放在内部缓冲区
+     */
+    bool isInline() const { return ops_ && ops_->isInline; }
+
+    /**
+     * @brief 释放持有的可调用对象
+     */
+    void reset() {
+        if(ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+private:
+    typedef typename std::aligned_storage<kInlineSize>::type Storage;
+
+    struct Ops {
+        void (*invoke)(void* storage);
+        /// 把 from 中的对象移动到 to, 并销毁 from 中的对象
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+        bool isInline;
+    };
+
+    template<class F>
+    struct InlineOps {
+        static void invoke(void* p) {
+            (*static_cast<F*>(p))();
+        }
+        static void move(void* from, void* to) {
+            F* f = static_cast<F*>(from);
+            new (to) F(std::move(*f));
+            f->~F();
+        }
+        static void destroy(void* p) {
+            static_cast<F*>(p)->~F();
+        }
+        static const Ops s_ops;
+    };
+
+    template<class F>
+    struct HeapOps {
+        static void invoke(void* p) {
+            (**static_cast<F**>(p))();
+        }
+        static void move(void* from, void* to) {
+            *static_cast<F**>(to) = *static_cast<F**>(from);
+        }
+        static void destroy(void* p) {
+            delete *static_cast<F**>(p);
+        }
+        static const Ops s_ops;
+    };
+
+    template<class F, class Arg>
+    void init(Arg&& f, std::true_type) {
+        new (&storage_) F(std::forward<Arg>(f));
+        ops_ = &InlineOps<F>::s_ops;
+    }
+
+    template<class F, class Arg>
+    void init(Arg&& f, std::false_type) {
+        *reinterpret_cast<F**>(&storage_) = new F(std::forward<Arg>(f));
+        ops_ = &HeapOps<F>::s_ops;
+    }
+
+    void moveFrom(Task& other) {
+        if(other.ops_) {
+            other.ops_->move(&other.storage_, &storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+private:
+    Storage storage_;
+    const Ops* ops_;
+};
+
+template<class F>
+const Task::Ops Task::InlineOps<F>::s_ops = {
+    &Task::InlineOps<F>::invoke,
+    &Task::InlineOps<F>::move,
+    &Task::InlineOps<F>::destroy,
+    true
+};
+
+template<class F>
+const Task::Ops Task::HeapOps<F>::s_ops = {
+    &Task::HeapOps<F>::invoke,
+    &Task::HeapOps<F>::move,
+    &Task::HeapOps<F>::destroy,
+    false
+};
+
+}
+
+#endif
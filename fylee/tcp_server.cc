@@ -1,5 +1,7 @@
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <errno.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include "tcp_server.h"
@@ -11,16 +13,70 @@
 #include "socket.h"
 #include "buffer.h"
 #include "connection.h"
+#include "config.h"
 #include "http/http_session.h"
 
 namespace fylee {
 static fylee::Logger::ptr g_logger = LOG_NAME("system");
 using namespace std::placeholders;
 
-Acceptor::Acceptor(EventLoop* loop, const Address::ptr addr) 
+static fylee::ConfigVar<bool>::ptr g_tcp_server_reuse_port =
+    fylee::Config::Lookup("tcp_server.reuse_port", false,
+                "each io loop owns a SO_REUSEPORT listening socket");
+
+static fylee::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    fylee::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+                "max connections accepted per acceptor wakeup");
+
+static fylee::ConfigVar<std::string>::ptr g_tcp_server_load_balance =
+    fylee::Config::Lookup("tcp_server.load_balance", std::string("round_robin"),
+                "io loop selection for new connections: round_robin, least_conn or ip_hash");
+
+static fylee::ConfigVar<int>::ptr g_tcp_server_busy_poll_us =
+    fylee::Config::Lookup("tcp_server.busy_poll_us", (int)0,
+                "SO_BUSY_POLL us set on accepted sockets, 0 disables");
+
+static fylee::ConfigVar<bool>::ptr g_tcp_server_completion_recv =
+    fylee::Config::Lookup("tcp_server.completion_recv", false,
+                "receive with io_uring multishot recv into per-loop provided buffers, needs eventloop.poller io_uring");
+
+static uint32_t s_tcp_server_accept_batch = 0;
+static int s_tcp_server_busy_poll_us = 0;
+static bool s_tcp_server_completion_recv = false;
+
+namespace {
+struct _AcceptorIniter {
+    _AcceptorIniter() {
+        s_tcp_server_accept_batch = g_tcp_server_accept_batch->getValue();
+        g_tcp_server_accept_batch->addListener(
+                [](const uint32_t& old_val, const uint32_t& new_val){
+                s_tcp_server_accept_batch = new_val;
+        });
+        s_tcp_server_busy_poll_us = g_tcp_server_busy_poll_us->getValue();
+        g_tcp_server_busy_poll_us->addListener(
+                [](const int& old_val, const int& new_val){
+                s_tcp_server_busy_poll_us = new_val;
+        });
+        s_tcp_server_completion_recv = g_tcp_server_completion_recv->getValue();
+        g_tcp_server_completion_recv->addListener(
+                [](const bool& old_val, const bool& new_val){
+                s_tcp_server_completion_recv = new_val;
+        });
+    }
+};
+static _AcceptorIniter _init;
+}
+
+Acceptor::Acceptor(EventLoop* loop, const Address::ptr addr, bool reusePort) 
     :loop_(loop),
      acceptSocket_(Socket::CreateTCP(addr)),
-     listenning_(false) {
+     listenning_(false),
+     idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+    ASSERT(idleFd_ >= 0);
+    if (reusePort && !acceptSocket_->setReusePort()) {
+        LOG_ERROR(g_logger) << "Acceptor set SO_REUSEPORT failed, addr="
+                            << addr->toString();
+    }
     acceptSocket_->bind(addr);
     acceptChannel_ = std::make_shared<Channel>(loop_, acceptSocket_->getSocket());
     acceptChannel_->setReadCallback(std::bind(&Acceptor::handleRead, this));
@@ -29,6 +85,9 @@ Acceptor::Acceptor(EventLoop* loop, const Address::ptr addr)
 Acceptor::~Acceptor() {
     acceptChannel_->disableAll();
     acceptChannel_->remove();
+    if (idleFd_ >= 0) {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen() {
@@ -41,15 +100,56 @@ void Acceptor::listen() {
 
 void Acceptor::handleRead() {
     loop_->assertInLoopThread();
-    Socket::ptr client;
-    while ((client = acceptSocket_->accept()) != nullptr) {
-        if (newConnectionCallback_) {
-            newConnectionCallback_(client);
+    if (!listenning_) {
+        return;
+    }
+    for (uint32_t i = 0; i < s_tcp_server_accept_batch; ++i) {
+        Socket::ptr client = acceptSocket_->acceptNonBlock();
+        if (client) {
+            if (s_tcp_server_busy_poll_us > 0) {
+                client->setBusyPoll(s_tcp_server_busy_poll_us);
+            }
+            if (newConnectionCallback_) {
+                newConnectionCallback_(client);
+            } else {
+                client->close();
+            }
+            continue;
+        }
+
+        int err = errno;
+        if (err == EAGAIN || err == EWOULDBLOCK) {
+            return;
+        } else if (err == EINTR || err == ECONNABORTED || err == EPROTO) {
+            continue;
+        } else if (err == EMFILE || err == ENFILE) {
+            // 监听套接字是边沿触发, 留在队列里的连接不会再通知, 
+            // 用预留的 fd 把它接下来并立即关闭, 让对端尽快收到结果
+            LOG_ERROR(g_logger) << "Acceptor::handleRead fd exhausted, errno="
+                << err << " errstr=" << strerror(err);
+            // accept 在检查队列前就先分配 fd, 队列为空时同样返回 EMFILE, 
+            // 借用预留 fd 也接不到连接说明队列已经清空
+            if (idleFd_ >= 0) {
+                ::close(idleFd_);
+            }
+            int fd = ::accept(acceptSocket_->getSocket(), nullptr, nullptr);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (fd < 0 || idleFd_ < 0) {
+                return;
+            }
+            continue;
         } else {
-            client->close();
+            LOG_ERROR(g_logger) << "Acceptor::handleRead accept(" 
+                << acceptSocket_->getSocket() << ") errno=" << err
+                << " errstr=" << strerror(err);
+            return;
         }
     }
-    LOG_ERROR(g_logger) << "in Acceptor::handleRead";
+    // 达到单次上限, 队列里可能还有连接但边沿触发不会再通知, 放到本轮事件处理之后继续
+    loop_->queueInLoop(std::bind(&Acceptor::handleRead, shared_from_this()));
 }
 
 TcpServer::TcpServer(EventLoop* loop, 
@@ -57,26 +157,36 @@ TcpServer::TcpServer(EventLoop* loop,
                      const std::string& name)
     :loop_(loop),
      name_(name),
-     acceptor_(new Acceptor(loop, addr)),
+     listenAddr_(addr),
      threadPool_(new EventLoopThreadPool(loop, name_)),
+     reusePort_(g_tcp_server_reuse_port->getValue()),
+     loadBalance_(LoadBalanceFromString(g_tcp_server_load_balance->getValue())),
      connectionCallback_([](const Connection::ptr conn) {
-         LOG_INFO(g_logger) << conn->getSocket()->toString() << " is " 
+         // 只记连接名(含 fd), 地址要 getsockname/getpeername, 放到 DEBUG
+         LOG_INFO(g_logger) << conn->getName() << " is "
                             << (conn->isConnected() ? "UP" : "DOWN");
+         LOG_DEBUG(g_logger) << conn->getName() << " " << conn->getSocket()->toString();
      }),
      messageCallback_([](const Connection::ptr conn, 
                          uint64_t receiveTime) { 
         Buffer::ptr inBuff = conn->inputBuffer();
-        inBuff->setPosition(0);
+        inBuff->clear();
      }),
      started_(false),
      nextConnId_(1) {
-    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, _1));
 }
 
 TcpServer::~TcpServer() {
     loop_->assertInLoopThread();
     LOG_INFO(g_logger) << "TcpServer::~TcpServer [" << name_ << "] destructing";
 
+    // 监听 Channel 必须在所属 loop 中移除
+    for (auto& acceptor : acceptors_) {
+        acceptor->getLoop()->runInLoop(std::bind([](Acceptor::ptr) {}, acceptor));
+    }
+    acceptors_.clear();
+
+    MutexType::Lock lock(mutex_);
     for (auto& item : connections_) {
         auto conn = item.second;
         item.second.reset();
@@ -84,6 +194,18 @@ TcpServer::~TcpServer() {
     }
 }
 
+TcpServer::LoadBalance TcpServer::LoadBalanceFromString(const std::string& str) {
+    if (str == "least_conn") {
+        return kLeastConnections;
+    } else if (str == "ip_hash") {
+        return kIpHash;
+    } else if (str != "round_robin") {
+        LOG_ERROR(g_logger) << "unknown load balance policy: " << str
+                            << ", use round_robin";
+    }
+    return kRoundRobin;
+}
+
 void TcpServer::setThreadNum(int numThreads) {
     ASSERT(0 <= numThreads);
     threadPool_->setThreadNum(numThreads);
@@ -109,51 +231,119 @@ void TcpServer::setWriteCompleteCallback(const WriteCompleteCallback& cb) {
     writeCompleteCallback_ = cb;
 }
 
+void TcpServer::setReusePort(bool v) {
+    ASSERT(!started_);
+    reusePort_ = v;
+}
+
 void TcpServer::start() {
     if (!started_) {
         started_ = true;
         threadPool_->start(threadInitCallback_);
-        ASSERT(!acceptor_->isListenning());
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_));
+        if (reusePort_) {
+            for (EventLoop* ioLoop : threadPool_->getAllLoops()) {
+                Acceptor::ptr acceptor(new Acceptor(ioLoop, listenAddr_, true));
+                acceptor->setNewConnectionCallback(
+                        std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, _1));
+                acceptors_.push_back(acceptor);
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+            }
+        } else {
+            acceptor_.reset(new Acceptor(loop_, listenAddr_));
+            acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, _1));
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_));
+        }
+    }
+}
+
+/// 只取 IP 部分, 忽略端口
+static size_t HashClientIp(const Address::ptr addr) {
+    const sockaddr* sa = addr->getAddr();
+    if (sa->sa_family == AF_INET) {
+        const sockaddr_in* sin = reinterpret_cast<const sockaddr_in*>(sa);
+        return std::hash<uint32_t>()(sin->sin_addr.s_addr);
+    } else if (sa->sa_family == AF_INET6) {
+        const sockaddr_in6* sin6 = reinterpret_cast<const sockaddr_in6*>(sa);
+        return std::hash<std::string>()(std::string(
+                    reinterpret_cast<const char*>(&sin6->sin6_addr), sizeof(sin6->sin6_addr)));
+    }
+    return 0;
+}
+
+EventLoop* TcpServer::selectLoop(const Socket::ptr client) {
+    switch (loadBalance_) {
+        case kLeastConnections:
+            return threadPool_->getLeastLoadedLoop();
+        case kIpHash:
+            return threadPool_->getLoopForHash(HashClientIp(client->getRemoteAddress()));
+        default:
+            return threadPool_->getNextLoop();
     }
 }
 
 void TcpServer::newConnection(const Socket::ptr client) {
     loop_->assertInLoopThread();
-    EventLoop* ioLoop = threadPool_->getNextLoop();
+    EventLoop* ioLoop = selectLoop(client);
+    Connection::ptr conn = createConnection(ioLoop, client);
+    ioLoop->runInLoop(std::bind(&Connection::connectEstablished, conn));
+}
+
+void TcpServer::newConnectionInLoop(EventLoop* ioLoop, const Socket::ptr client) {
+    ioLoop->assertInLoopThread();
+    createConnection(ioLoop, client)->connectEstablished();
+}
+
+Connection::ptr TcpServer::createConnection(EventLoop* ioLoop, const Socket::ptr client) {
+    // SO_REUSEPORT 模式下各 IO 线程会同时建立连接, nextConnId_ 与 connections_ 需要加锁
+    int connId = 0;
+    {
+        MutexType::Lock lock(mutex_);
+        connId = nextConnId_++;
+    }
+    // 连接名只用 fd 和序号, 对端地址在需要时才通过 getpeername 获取
     std::stringstream ss;
-    ss << name_ << " " << client->toString() << " " << nextConnId_;
+    ss << name_ << " sock=" << client->getSocket() << " " << connId;
     std::string connName = ss.str();
     std::transform(connName.begin(), connName.end(), connName.begin(), ::tolower);
-    ++nextConnId_;
     LOG_INFO(g_logger) << "TcpServer::newConnection [" << name_
-            << "] - new connection [" << connName
-            << "] from " << client->toString();
+            << "] - new connection [" << connName << "]";
+    LOG_DEBUG(g_logger) << "TcpServer::newConnection [" << connName
+            << "] from " << client->getRemoteAddress()->toString();
     SocketStream::ptr stream;
     if (name_ == "HttpServer")
         stream = std::make_shared<http::HttpSession>(client, false);
     else 
         stream = std::make_shared<SocketStream>(client, false);
     Connection::ptr conn = std::make_shared<Connection>(ioLoop, connName, client, stream);
+    // 分配时就计数, 连接在 IO 线程真正建立前也能被最少连接策略看到
+    ioLoop->incConnectionCount();
+    MutexType::Lock lock(mutex_);
     connections_[connName] = conn;
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection, shared_from_this(), _1)); 
-    ioLoop->runInLoop(std::bind(&Connection::connectEstablished, conn));
+    conn->setCompletionRecv(s_tcp_server_completion_recv);
+    return conn;
 }
 
 void TcpServer::removeConnection(const Connection::ptr conn) {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, shared_from_this(), conn));
+    // SO_REUSEPORT 模式下连接就在所属的 IO loop 中移除, 不再回到 base loop
+    EventLoop* loop = reusePort_ ? conn->getLoop() : loop_;
+    loop->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, shared_from_this(), conn));
 }
 
 void TcpServer::removeConnectionInLoop(const Connection::ptr conn) {
-    loop_->assertInLoopThread();
+    EventLoop* ioLoop = conn->getLoop();
+    (reusePort_ ? ioLoop : loop_)->assertInLoopThread();
     LOG_INFO(g_logger) << "TcpServer::removeConnectionInLoop [" << name_
             << "] - connection " << conn->getName();
-    size_t n = connections_.erase(conn->getName());
-    ASSERT(n == 1);
-    EventLoop* ioLoop = conn->getLoop();
+    {
+        MutexType::Lock lock(mutex_);
+        size_t n = connections_.erase(conn->getName());
+        ASSERT(n == 1);
+    }
+    ioLoop->decConnectionCount();
     ioLoop->queueInLoop(
         std::bind(&Connection::connectDestroyed, conn));
 }
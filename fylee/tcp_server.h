@@ -6,6 +6,7 @@
 #include <string>
 #include <stdint.h>
 #include <map>
+#include <vector>
 #include "noncopyable.h"
 #include "mutex.h"
 
@@ -28,9 +29,17 @@ public:
     typedef std::shared_ptr<Acceptor> ptr;
     typedef std::function<void (const std::shared_ptr<Socket>)> NewConnectionCallback;
 
-    Acceptor(EventLoop* loop, const std::shared_ptr<Address> listenAddr);
+    /**
+     * @brief 构造函数
+     * @param[in] loop 监听套接字所在的 EventLoop
+     * @param[in] listenAddr 监听地址
+     * @param[in] reusePort 是否在 bind 前设置 SO_REUSEPORT, 允许多个 Acceptor 监听同一地址
+     */
+    Acceptor(EventLoop* loop, const std::shared_ptr<Address> listenAddr, bool reusePort = false);
     ~Acceptor();
 
+    EventLoop* getLoop() const { return loop_; }
+
     void setNewConnectionCallback(const NewConnectionCallback& cb) { newConnectionCallback_ = cb; }
 
     bool isListenning() const { return listenning_; }
@@ -43,6 +52,8 @@ private:
     std::shared_ptr<Channel> acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
     bool listenning_;
+    // 预留的空闲 fd, 进程 fd 耗尽(EMFILE)时释放它来 accept 并关闭新连接
+    int idleFd_;
 };
 
 class TcpServer : public std::enable_shared_from_this<TcpServer>, Noncopyable {
@@ -51,6 +62,23 @@ public:
     typedef std::function<void(EventLoop*)> ThreadInitCallback;
     typedef Mutex MutexType;
 
+    /**
+     * @brief 新连接分配到 IO 线程的策略
+     */
+    enum LoadBalance {
+        /// 轮询
+        kRoundRobin = 0,
+        /// 活跃连接数最少的 loop
+        kLeastConnections = 1,
+        /// 按客户端 IP 哈希, 同一客户端总落在同一个 loop
+        kIpHash = 2,
+    };
+
+    /**
+     * @brief 策略名(round_robin/least_conn/ip_hash)转为枚举, 无法识别时返回 kRoundRobin
+     */
+    static LoadBalance LoadBalanceFromString(const std::string& str);
+
     TcpServer(EventLoop* loop, const std::shared_ptr<Address> addr, const std::string& name);
     virtual ~TcpServer(); 
 
@@ -73,8 +101,27 @@ public:
 
     void setWriteCompleteCallback(const WriteCompleteCallback& cb); 
 
+    /**
+     * @brief 设置是否使用 SO_REUSEPORT 多 Acceptor 模式, 需在 start() 前调用
+     * @details 开启后每个 IO 线程的 EventLoop 各自持有一个监听套接字,
+     *          由内核把新连接分散到各个监听套接字上, accept 与连接处理都在同一线程完成,
+     *          不再经过 base loop 转发. 默认值取自配置 tcp_server.reuse_port
+     */
+    void setReusePort(bool v);
+    bool isReusePort() const { return reusePort_; }
+
+    /**
+     * @brief 设置新连接的分配策略, 默认值取自配置 tcp_server.load_balance
+     * @details SO_REUSEPORT 模式下由内核分配连接, 该策略不生效
+     */
+    void setLoadBalance(LoadBalance v) { loadBalance_ = v; }
+    LoadBalance getLoadBalance() const { return loadBalance_; }
+
 private:
     void newConnection(const std::shared_ptr<Socket> addr);
+    EventLoop* selectLoop(const std::shared_ptr<Socket> client);
+    void newConnectionInLoop(EventLoop* ioLoop, const std::shared_ptr<Socket> client);
+    std::shared_ptr<Connection> createConnection(EventLoop* ioLoop, const std::shared_ptr<Socket> client);
     void removeConnection(const std::shared_ptr<Connection> conn);
     void removeConnectionInLoop(const std::shared_ptr<Connection> conn);
 private:
@@ -83,8 +130,13 @@ private:
     mutable MutexType mutex_;
     EventLoop* loop_;  // the acceptor loop
     std::string name_;
+    std::shared_ptr<Address> listenAddr_;
     Acceptor::ptr acceptor_; 
     std::shared_ptr<EventLoopThreadPool> threadPool_;
+    // SO_REUSEPORT 模式下每个 IO loop 一个 Acceptor
+    std::vector<Acceptor::ptr> acceptors_;
+    bool reusePort_;
+    LoadBalance loadBalance_;
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
@@ -1,19 +1,14 @@
 #include "timer.h"
 #include "util.h"
+#include "eventloop.h"
 
 namespace fylee {
 
-bool Timer::Comparator::operator()(const Timer::ptr& lhs
-                        ,const Timer::ptr& rhs) const {
-    return lhs->next_ > rhs->next_;
-}
-
-
 Timer::Timer(uint64_t ms, Functor func, bool recurring)
     :recurring_(recurring),
      ms_(ms),
      func_(std::move(func)) {
-    next_ = fylee::GetCurrentMS() + ms_;
+    next_ = EventLoop::Now() + ms_;
 }
 
 Timer::Timer(uint64_t next)
@@ -8,15 +8,24 @@
 
 namespace fylee {
 class TimerQueue;
+class TimingWheel;
 
 class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerQueue;
+friend class TimingWheel;
 public:
     typedef std::function<void()> Functor;
     typedef std::shared_ptr<Timer> ptr;
     
     uint64_t getExpiration() { return next_; }
 
+    /// 是否由时间轮管理
+    bool isWheelTimer() const { return wheel_; }
+
+    bool isRecurring() const { return recurring_; }
+
+    const Functor& getFunctor() const { return func_; }
+
     Timer(uint64_t ms, Functor func, bool recurring);
     Timer(uint64_t next);
 private:
@@ -30,10 +39,36 @@ private:
     uint64_t next_ = 0;
     // 回调函数
     Functor func_;
-  
-    struct Comparator {
-        bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-    };
+    // 在 TimerQueue 堆中的下标, 不在堆中时为 -1
+    int64_t heapIndex_ = -1;
+
+    // 以下为时间轮使用的侵入式双向链表
+    // 是否属于时间轮
+    bool wheel_ = false;
+    // 到期的 tick
+    uint64_t wheelExpire_ = 0;
+    // 所在槽位的链表头, 不在时间轮中时为 nullptr
+    Timer** wheelSlot_ = nullptr;
+    Timer* wheelPrev_ = nullptr;
+    Timer* wheelNext_ = nullptr;
+    // 链在时间轮中时持有自身, 保证调用方丢掉句柄后仍能触发
+    Timer::ptr wheelSelf_;
+};
+
+/**
+ * @brief 定时器堆的统计, 用于观察堆大小和定时器的增删情况
+ */
+struct TimerStats {
+    /// 堆中的定时器个数, 取消即移除, 等于存活的定时器个数
+    size_t heapSize = 0;
+    /// 累计添加的定时器
+    uint64_t added = 0;
+    /// 累计取消并从堆中移除的定时器, 旧实现中它们会作为墓碑一直留到到期
+    uint64_t cancelled = 0;
+    /// 累计原地重设的定时器
+    uint64_t restarted = 0;
+    /// 累计触发的回调次数
+    uint64_t fired = 0;
 };
 
 }
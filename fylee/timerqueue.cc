@@ -8,20 +8,27 @@
 
 namespace fylee {
 static fylee::Logger::ptr g_logger = LOG_NAME("system");
-TimerQueue::TimerQueue(EventLoop* loop) 
+TimerQueue::TimerQueue(EventLoop* loop, bool useTimerfd) 
     :loop_(loop),
-     timerfd_(createTimerfd()),
-     timerfdChannel_(new Channel(loop, timerfd_)),
+     timerfd_(useTimerfd ? createTimerfd() : -1),
      callingExpiredTimers_(false) {
-    previouseTime_ = fylee::GetCurrentMS();
-    timerfdChannel_->setReadCallback(std::bind(&TimerQueue::handleRead, this));
-    timerfdChannel_->enableReading();
+    if(timerfd_ >= 0) {
+        timerfdChannel_.reset(new Channel(loop, timerfd_));
+        timerfdChannel_->setReadCallback(std::bind(&TimerQueue::handleRead, this));
+        timerfdChannel_->enableReading();
+    }
 }
 
 TimerQueue::~TimerQueue() {
-    timerfdChannel_->disableAll();
-    timerfdChannel_->remove();
-    close(timerfd_);
+    if(timerfdChannel_) {
+        timerfdChannel_->disableAll();
+        timerfdChannel_->remove();
+        close(timerfd_);
+    }
+    // 调用方可能还持有 Timer 句柄
+    for(auto& timer : timers_) {
+        timer->heapIndex_ = -1;
+    }
 }
 
 Timer::ptr TimerQueue::addTimer(uint64_t ms, Functor func, bool recurring) {
@@ -34,41 +41,125 @@ void TimerQueue::cancelTimer(Timer::ptr timer) {
     loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timer));
 }
 
+void TimerQueue::restartTimer(Timer::ptr timer, uint64_t ms) {
+    loop_->runInLoop(std::bind(&TimerQueue::restartInLoop, this, timer, ms));
+}
+
 void TimerQueue::addTimerInLoop(Timer::ptr timer) {
     RWMutexType::WriteLock lock(mutex_);
-    timers_.push(timer);
-    bool at_front = (timer == timers_.top()) && !tickled_;
-    if(at_front) {
-        tickled_ = true;
+    if(timer->deleted_) {
+        return;
     }
-    lock.unlock();
+    ++stats_.added;
+    // 排到堆顶时由下一次 poll 之前的 rearm() 重设 timerfd
+    heapPush(timer);
+}
 
-    if(at_front) {
-        onTimerInsertedAtFront(timer->getExpiration());
+void TimerQueue::cancelInLoop(Timer::ptr timer) {
+    loop_->assertInLoopThread();
+    RWMutexType::WriteLock lock(mutex_);
+    // 一次性定时器触发后已不在堆中, 再取消是正常情况
+    if(timer->heapIndex_ >= 0) {
+        heapErase(timer.get());
+        ++stats_.cancelled;
     }
+    timer->func_ = nullptr;
+    timer->deleted_ = true;
 }
 
-void TimerQueue::cancelInLoop(Timer::ptr timer) {
+void TimerQueue::restartInLoop(Timer::ptr timer, uint64_t ms) {
     loop_->assertInLoopThread();
     RWMutexType::WriteLock lock(mutex_);
-    bool rt = false;
-    if(timer->func_) {
-        timer->func_ = nullptr;
-        timer->deleted_ = true;
-        rt = true;
+    if(timer->deleted_ || !timer->func_) {
+        return;
+    }
+    timer->ms_ = ms;
+    timer->next_ = loop_->now() + ms;
+    if(timer->heapIndex_ >= 0) {
+        heapFix(timer->heapIndex_);
+    } else {
+        heapPush(timer);
     }
-    ASSERT(rt);
+    ++stats_.restarted;
+}
+
+bool TimerQueue::heapPush(const Timer::ptr& timer) {
+    timer->heapIndex_ = timers_.size();
+    timers_.push_back(timer);
+    siftUp(timers_.size() - 1);
+    return timer->heapIndex_ == 0;
+}
+
+void TimerQueue::heapErase(Timer* timer) {
+    size_t idx = timer->heapIndex_;
+    size_t last = timers_.size() - 1;
+    // 可能是最后一个引用, 处理完再释放
+    Timer::ptr self;
+    self.swap(timers_[idx]);
+    timer->heapIndex_ = -1;
+    if(idx != last) {
+        heapSet(idx, std::move(timers_[last]));
+        timers_.pop_back();
+        heapFix(idx);
+    } else {
+        timers_.pop_back();
+    }
+}
+
+void TimerQueue::heapFix(size_t idx) {
+    if(idx > 0 && timers_[idx]->next_ < timers_[(idx - 1) / 2]->next_) {
+        siftUp(idx);
+    } else {
+        siftDown(idx);
+    }
+}
+
+void TimerQueue::siftUp(size_t idx) {
+    Timer::ptr timer = std::move(timers_[idx]);
+    while(idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if(timers_[parent]->next_ <= timer->next_) {
+            break;
+        }
+        heapSet(idx, std::move(timers_[parent]));
+        idx = parent;
+    }
+    heapSet(idx, std::move(timer));
+}
+
+void TimerQueue::siftDown(size_t idx) {
+    size_t size = timers_.size();
+    Timer::ptr timer = std::move(timers_[idx]);
+    while(true) {
+        size_t child = idx * 2 + 1;
+        if(child >= size) {
+            break;
+        }
+        if(child + 1 < size && timers_[child + 1]->next_ < timers_[child]->next_) {
+            ++child;
+        }
+        if(timer->next_ <= timers_[child]->next_) {
+            break;
+        }
+        heapSet(idx, std::move(timers_[child]));
+        idx = child;
+    }
+    heapSet(idx, std::move(timer));
+}
+
+void TimerQueue::heapSet(size_t idx, Timer::ptr timer) {
+    timer->heapIndex_ = idx;
+    timers_[idx] = std::move(timer);
 }
 
 uint64_t TimerQueue::getNextTimer() {
     RWMutexType::ReadLock lock(mutex_);
-    tickled_ = false;
     if(timers_.empty()) { // 返回0ull表示没有定时器事件了
         return ~0ull;
     }
 
-    auto next = timers_.top();
-    uint64_t now_ms = fylee::GetCurrentMS();
+    auto& next = timers_.front();
+    uint64_t now_ms = loop_->now();
     if(now_ms >= next->next_) {
         return 0;
     } else {
@@ -78,70 +169,43 @@ uint64_t TimerQueue::getNextTimer() {
 
 uint64_t TimerQueue::getFrontTimer() {
     RWMutexType::ReadLock lock(mutex_);
-    tickled_ = false;
     if(timers_.empty()) { // 返回0ull表示没有定时器事件了
         return ~0ull;
     }
-
-    auto next = timers_.top();
-    return next->next_;
+    return timers_.front()->next_;
 }
 
-void TimerQueue::listExpiredFunc(std::vector<Functor>& funcs) {
-    uint64_t now_ms = fylee::GetCurrentMS();
-    std::vector<Timer::ptr> expired;
-    {
-        RWMutexType::ReadLock lock(mutex_);
-        if(timers_.empty()) {
-            return;
-        }
-    }
+void TimerQueue::listExpired(std::vector<Timer::ptr>& expired) {
+    // 单调时钟不会回退, 不再需要检测系统时间被调后
+    uint64_t now_ms = loop_->now();
     RWMutexType::WriteLock lock(mutex_);
-    if(timers_.empty()) {
-        return;
-    }
-    bool rollover = detectClockRollover(now_ms); // 检测是否超时仍未执行
-    if(!rollover && (timers_.top()->next_ > now_ms)) {
-        return;
-    }
-    std::vector<Timer::ptr> expires;
-    while (!timers_.empty()) {
-        auto cur = timers_.top();
-        if (cur->next_ > now_ms) 
-            break;
-        else {
-            expires.push_back(cur);
-            timers_.pop();
-        }
+    while(!timers_.empty() && timers_.front()->next_ <= now_ms) {
+        Timer::ptr timer = timers_.front();
+        heapErase(timer.get());
+        expired.push_back(std::move(timer));
     }
-    funcs.reserve(expires.size());
-    for (auto& timer : expires) {
-        if (timer->deleted_) continue;
-        funcs.push_back(timer->func_);
-        if (timer->recurring_) {
+    stats_.fired += expired.size();
+    // 先把循环定时器放回去, 回调里再取消也能从堆中移除
+    for(auto& timer : expired) {
+        if(timer->recurring_) {
             timer->next_ = now_ms + timer->ms_;
-            timers_.push(timer);
-        } else {
-            timer->func_ = nullptr;
+            heapPush(timer);
         }
     }
 }
 
-bool TimerQueue::detectClockRollover(uint64_t now_ms) {
-    bool rollover = false;
-    if(now_ms < previouseTime_ &&
-            now_ms < (previouseTime_ - 60 * 60 * 1000)) {
-        rollover = true;
-    }
-    previouseTime_ = now_ms;
-    return rollover;
-}
-
 bool TimerQueue::hasTimer() {
     RWMutexType::ReadLock lock(mutex_);
     return !timers_.empty();
 }
 
+TimerStats TimerQueue::getStats() {
+    RWMutexType::ReadLock lock(mutex_);
+    TimerStats stats = stats_;
+    stats.heapSize = timers_.size();
+    return stats;
+}
+
 int TimerQueue::createTimerfd() {
     int timerfd = ::timerfd_create(CLOCK_MONOTONIC,
                                     TFD_NONBLOCK | TFD_CLOEXEC);
@@ -153,8 +217,9 @@ int TimerQueue::createTimerfd() {
 
 struct timespec TimerQueue::howMuchTimeFromNow(uint64_t when_ms) {
     static const uint64_t uSecPerSec = 1000 * 1000;
-    uint64_t now_us = fylee::GetCurrentUS();
-    uint64_t from_now_us = when_ms * 1000ul - now_us;
+    // 设置 timerfd 时读一次真实时钟, 缓存的 now 可能落后于本轮事件处理的耗时
+    uint64_t now_us = fylee::GetMonotonicUS();
+    uint64_t from_now_us = when_ms * 1000ul > now_us ? when_ms * 1000ul - now_us : 0;
     if(from_now_us < 100) {
         from_now_us = 100;
     }
@@ -188,25 +253,40 @@ void TimerQueue::resetTimerfd(int timerfd, uint64_t expiration) {
 
 void TimerQueue::handleRead() {
     loop_->assertInLoopThread();
-    std::vector<Functor> expired;
-    listExpiredFunc(expired);
-  
-    uint64_t now_ms = fylee::GetCurrentMS();
-    readTimerfd(timerfd_, now_ms);
+    readTimerfd(timerfd_, loop_->now());
+    armedExpiration_ = 0;
+    processExpired();
+}
+
+void TimerQueue::processExpired() {
+    loop_->assertInLoopThread();
+    std::vector<Timer::ptr> expired;
+    listExpired(expired);
 
     callingExpiredTimers_ = true;
-    for (auto& it : expired) {
-        it();
+    for (auto& timer : expired) {
+        // 前面的回调可能取消或重设了它
+        if (timer->deleted_ || !timer->func_
+                || (!timer->recurring_ && timer->heapIndex_ >= 0)) {
+            continue;
+        }
+        Functor func = timer->func_;
+        func();
     }
     callingExpiredTimers_ = false;
-    uint64_t nextExpire = getFrontTimer();
-    if(nextExpire < ~0ull) {
-        resetTimerfd(timerfd_, nextExpire);
-    }
 }
 
-void TimerQueue::onTimerInsertedAtFront(uint64_t earliest) {
-    resetTimerfd(timerfd_, earliest);
+void TimerQueue::rearm() {
+    if(timerfd_ < 0) {
+        return;
+    }
+    uint64_t next = getFrontTimer();
+    // 没有定时器或堆顶变晚时保持原样, 最多提前唤醒一次
+    if(next == ~0ull || (armedExpiration_ && armedExpiration_ <= next)) {
+        return;
+    }
+    armedExpiration_ = next;
+    resetTimerfd(timerfd_, next);
 }
 
 }
\ No newline at end of file
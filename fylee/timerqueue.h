@@ -3,7 +3,7 @@
 
 #include <functional>
 #include <atomic>
-#include <queue>
+#include <vector>
 #include "timer.h"
 #include "noncopyable.h"
 
@@ -11,45 +11,96 @@ namespace fylee {
 class EventLoop;
 class Channel;
 
+/**
+ * @brief 基于最小堆的定时器队列
+ * @details 堆中的 Timer 记录自己的下标(Timer::heapIndex_), 取消和重设都是 O(log n)
+ *          的原地操作, 取消后立即从堆中移除, 不会留下墓碑.
+ *          使用 timerfd 时, 增删定时器不直接设置 timerfd, 由 EventLoop 在 poll 之前
+ *          调用 rearm(), 每轮最多一次 timerfd_settime; 不使用 timerfd 时没有额外的 fd,
+ *          EventLoop 按 getFrontTimer() 计算 poll 的超时时间, 返回后调用 processExpired()
+ */
 class TimerQueue : public Noncopyable {
 friend class Timer;
 public:
     typedef std::function<void()> Functor;
-  
+
     typedef RWMutex RWMutexType;
 
-    TimerQueue(EventLoop* loop);
+    /**
+     * @brief 构造函数
+     * @param[in] loop 所属 EventLoop
+     * @param[in] useTimerfd 是否使用 timerfd 唤醒 loop
+     */
+    TimerQueue(EventLoop* loop, bool useTimerfd = true);
 
     ~TimerQueue();
 
     Timer::ptr addTimer(uint64_t ms, Functor func, bool recurring = false);
-    
+
+    /**
+     * @brief 取消定时器, 立即从堆中移除
+     */
     void cancelTimer(Timer::ptr timer);
 
+    /**
+     * @brief 把定时器重新设为 ms 毫秒后到期, 已触发的一次性定时器也可以重设
+     * @details 在堆中原地调整位置, 不分配内存; 已取消的定时器不能重设
+     */
+    void restartTimer(Timer::ptr timer, uint64_t ms);
+
+    /**
+     * @brief 距最近一个定时器到期的毫秒数, 按 loop 缓存的单调时钟计算
+     */
     uint64_t getNextTimer();
 
+    /**
+     * @brief 最近一个定时器的到期时间(单调时钟毫秒), 没有定时器时返回 ~0ull
+     */
     uint64_t getFrontTimer();
 
-    void listExpiredFunc(std::vector<Functor >& funcs);
-
     bool hasTimer();
 
-    void onTimerInsertedAtFront(uint64_t earliest);
+    /**
+     * @brief 统计信息, 可在任意线程调用
+     */
+    TimerStats getStats();
+
+    /**
+     * @brief 最近的到期时间比 timerfd 设置的更早时重设 timerfd, 需在 loop 线程调用
+     * @details 堆顶变晚时不重设, timerfd 提前触发一次后再按新的堆顶设置
+     */
+    void rearm();
+
+    /**
+     * @brief 执行已到期的定时器, 需在 loop 线程调用
+     */
+    void processExpired();
+
+    bool isTimerfd() const { return timerfd_ >= 0; }
 
 private:
     RWMutexType mutex_;
 
-    std::priority_queue<Timer::ptr, std::deque<Timer::ptr>, 
-                        Timer::Comparator> timers_; // minheap
-  
-    bool tickled_ = false;  // 是否触发onTimerInsertedAtFront
-    // 上次执行时间
-    uint64_t previouseTime_ = 0;
+    // 按 next_ 排列的最小堆
+    std::vector<Timer::ptr> timers_;
 
-    /**
-     * 检测服务器时间是否被调后了
-     */
-    bool detectClockRollover(uint64_t now_ms);
+    // timerfd 当前设置的到期时间, 0 表示未设置
+    uint64_t armedExpiration_ = 0;
+
+    TimerStats stats_;
+
+    /// 放入堆中, 返回是否成为堆顶
+    bool heapPush(const Timer::ptr& timer);
+    /// 从堆中移除 timer, 需持有写锁
+    void heapErase(Timer* timer);
+    /// timer 的 next_ 改变后恢复堆序
+    void heapFix(size_t idx);
+    void siftUp(size_t idx);
+    void siftDown(size_t idx);
+    void heapSet(size_t idx, Timer::ptr timer);
+
+    /// 取出已到期的定时器, 循环定时器按下一周期放回堆中
+    void listExpired(std::vector<Timer::ptr>& expired);
 
     int createTimerfd();
     struct timespec howMuchTimeFromNow(uint64_t when_ms);
@@ -57,6 +108,7 @@ private:
     void resetTimerfd(int timerfd, uint64_t expiration);
     void addTimerInLoop(Timer::ptr timer);
     void cancelInLoop(Timer::ptr timer);
+    void restartInLoop(Timer::ptr timer, uint64_t ms);
     // called when timerfd alarms
     void handleRead();
 
@@ -66,4 +118,4 @@ private:
     std::atomic_bool callingExpiredTimers_;
 };
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,320 @@
+#include "timing_wheel.h"
+#include "eventloop.h"
+#include "channel.h"
+#include "log.h"
+#include "util.h"
+#include "macro.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+namespace fylee {
+static fylee::Logger::ptr g_logger = LOG_NAME("system");
+
+TimingWheel::TimingWheel(EventLoop* loop, uint64_t tickMs, bool useTimerfd)
+    :loop_(loop),
+     tickMs_(tickMs ? tickMs : 1),
+     startMs_(loop->now()),
+     currentTick_(0),
+     armedTick_(0),
+     rearmPending_(false),
+     count_(0),
+     timerfd_(useTimerfd ? ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) : -1) {
+    memset(levelCount_, 0, sizeof(levelCount_));
+    memset(slots_, 0, sizeof(slots_));
+    memset(bitmap_, 0, sizeof(bitmap_));
+    if(!useTimerfd) {
+        return;
+    }
+    if(timerfd_ < 0) {
+        LOG_FATAL(g_logger) << "TimingWheel timerfd_create failed errno=" << errno
+            << " errstr=" << strerror(errno);
+    }
+    timerfdChannel_.reset(new Channel(loop, timerfd_));
+    timerfdChannel_->setReadCallback(std::bind(&TimingWheel::handleRead, this));
+    timerfdChannel_->enableReading();
+}
+
+TimingWheel::~TimingWheel() {
+    for(int level = 0; level < kLevels; ++level) {
+        for(int i = 0; i < kSlots; ++i) {
+            while(slots_[level][i]) {
+                unlink(slots_[level][i]);
+            }
+        }
+    }
+    if(timerfdChannel_) {
+        timerfdChannel_->disableAll();
+        timerfdChannel_->remove();
+        close(timerfd_);
+    }
+}
+
+Timer::ptr TimingWheel::addTimer(uint64_t ms, Functor func, bool recurring) {
+    Timer::ptr timer(new Timer(ms, std::move(func), recurring));
+    timer->wheel_ = true;
+    loop_->runInLoop(std::bind(&TimingWheel::addTimerInLoop, this, timer));
+    return timer;
+}
+
+void TimingWheel::cancelTimer(Timer::ptr timer) {
+    loop_->runInLoop(std::bind(&TimingWheel::cancelInLoop, this, timer));
+}
+
+void TimingWheel::restartTimer(Timer::ptr timer, uint64_t ms) {
+    loop_->runInLoop(std::bind(&TimingWheel::restartInLoop, this, timer, ms));
+}
+
+void TimingWheel::addTimerInLoop(Timer::ptr timer) {
+    loop_->assertInLoopThread();
+    if(timer->deleted_) {
+        return;
+    }
+    timer->wheelExpire_ = toExpireTick(timer->next_);
+    timer->wheelSelf_ = timer;
+    link(timer.get());
+    // 同一轮可能添加很多定时器, 到 poll 之前的 rearm() 再统一设置
+    if(armedTick_ == 0 || timer->wheelExpire_ < armedTick_) {
+        rearmPending_ = true;
+    }
+}
+
+void TimingWheel::cancelInLoop(Timer::ptr timer) {
+    loop_->assertInLoopThread();
+    if(timer->wheelSlot_) {
+        unlink(timer.get());
+    }
+    timer->deleted_ = true;
+    timer->func_ = nullptr;
+}
+
+void TimingWheel::restartInLoop(Timer::ptr timer, uint64_t ms) {
+    loop_->assertInLoopThread();
+    if(timer->deleted_ || !timer->func_) {
+        return;
+    }
+    if(timer->wheelSlot_) {
+        unlink(timer.get());
+    }
+    timer->ms_ = ms;
+    timer->next_ = loop_->now() + ms;
+    addTimerInLoop(timer);
+}
+
+uint64_t TimingWheel::toExpireTick(uint64_t ms) const {
+    uint64_t tick = ms > startMs_ ? (ms - startMs_ + tickMs_ - 1) / tickMs_ : 0;
+    // 至少是下一个 tick, 当前 tick 已经处理过了
+    return tick > currentTick_ ? tick : currentTick_ + 1;
+}
+
+void TimingWheel::link(Timer* timer) {
+    uint64_t expire = timer->wheelExpire_;
+    uint64_t diff = expire > currentTick_ ? expire - currentTick_ : 0;
+    int level = 0;
+    while(level < kLevels - 1 && diff >= (1ull << (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+    if(level == kLevels - 1 && diff >= (1ull << (kSlotBits * kLevels))) {
+        // 超出时间轮范围, 先挂在最高层最远的槽上, 下放时会重新计算
+        expire = currentTick_ + (1ull << (kSlotBits * kLevels)) - 1;
+    }
+    // 到期时间早于当前 tick 的(下放时)放在当前槽, 本 tick 内处理
+    if(diff == 0) {
+        expire = currentTick_;
+    }
+    size_t idx = (expire >> (kSlotBits * level)) & kSlotMask;
+    Timer** head = &slots_[level][idx];
+    timer->wheelSlot_ = head;
+    timer->wheelPrev_ = nullptr;
+    timer->wheelNext_ = *head;
+    if(*head) {
+        (*head)->wheelPrev_ = timer;
+    }
+    *head = timer;
+    if(level == 0) {
+        bitmap_[idx >> 6] |= 1ull << (idx & 63);
+    }
+    ++levelCount_[level];
+    ++count_;
+}
+
+void TimingWheel::unlink(Timer* timer) {
+    Timer** head = timer->wheelSlot_;
+    if(timer->wheelPrev_) {
+        timer->wheelPrev_->wheelNext_ = timer->wheelNext_;
+    } else {
+        *head = timer->wheelNext_;
+    }
+    if(timer->wheelNext_) {
+        timer->wheelNext_->wheelPrev_ = timer->wheelPrev_;
+    }
+    size_t offset = head - &slots_[0][0];
+    int level = offset >> kSlotBits;
+    size_t idx = offset & kSlotMask;
+    if(level == 0 && !*head) {
+        bitmap_[idx >> 6] &= ~(1ull << (idx & 63));
+    }
+    --levelCount_[level];
+    --count_;
+    timer->wheelSlot_ = nullptr;
+    timer->wheelPrev_ = nullptr;
+    timer->wheelNext_ = nullptr;
+    // 可能是最后一个引用, 放在最后
+    Timer::ptr self;
+    self.swap(timer->wheelSelf_);
+}
+
+void TimingWheel::cascade(int level) {
+    size_t idx = (currentTick_ >> (kSlotBits * level)) & kSlotMask;
+    Timer* timer = slots_[level][idx];
+    while(timer) {
+        Timer* next = timer->wheelNext_;
+        // unlink 会释放 wheelSelf_, 先持有
+        Timer::ptr self = timer->wheelSelf_;
+        unlink(timer);
+        timer->wheelSelf_ = self;
+        link(timer);
+        timer = next;
+    }
+}
+
+void TimingWheel::advance(uint64_t now_ms, std::vector<Timer::ptr>& expired) {
+    uint64_t target = now_ms > startMs_ ? toTick(now_ms) : 0;
+    if(count_ == 0) {
+        if(target > currentTick_) {
+            currentTick_ = target;
+        }
+        return;
+    }
+    while(currentTick_ < target && count_ > 0) {
+        // 中间没有到期槽也不需要下放的 tick 直接跳过
+        uint64_t next = nextTick();
+        if(next > target) {
+            currentTick_ = target;
+            break;
+        }
+        currentTick_ = next;
+        size_t idx = currentTick_ & kSlotMask;
+        if(idx == 0) {
+            for(int level = 1; level < kLevels; ++level) {
+                cascade(level);
+                if((currentTick_ >> (kSlotBits * level)) & kSlotMask) {
+                    break;
+                }
+            }
+        }
+        while(Timer* timer = slots_[0][idx]) {
+            expired.push_back(timer->wheelSelf_);
+            unlink(timer);
+        }
+    }
+    if(count_ == 0 && target > currentTick_) {
+        currentTick_ = target;
+    }
+}
+
+uint64_t TimingWheel::nextTick() const {
+    if(count_ == 0) {
+        return 0;
+    }
+    uint64_t next = 0;
+    if(levelCount_[0] > 0) {
+        size_t cur = currentTick_ & kSlotMask;
+        for(size_t d = 1; d < (size_t)kSlots; ++d) {
+            size_t idx = (cur + d) & kSlotMask;
+            uint64_t word = bitmap_[idx >> 6] >> (idx & 63);
+            if(!word) {
+                // 跳到下一个 64 位字的开头
+                d += 63 - (idx & 63);
+                continue;
+            }
+            d += __builtin_ctzll(word);
+            if(d < (size_t)kSlots) {
+                next = currentTick_ + d;
+            }
+            break;
+        }
+    }
+    if(count_ > levelCount_[0]) {
+        // 最低层转完一圈时要从上层下放
+        uint64_t boundary = (currentTick_ | kSlotMask) + 1;
+        if(next == 0 || boundary < next) {
+            next = boundary;
+        }
+    }
+    return next;
+}
+
+void TimingWheel::rearm() {
+    if(rearmPending_) {
+        schedule();
+    }
+}
+
+void TimingWheel::schedule() {
+    uint64_t tick = nextTick();
+    armedTick_ = tick;
+    rearmPending_ = false;
+    if(timerfd_ < 0) {
+        return;
+    }
+    struct itimerspec value;
+    memset(&value, 0, sizeof(value));
+    if(tick) {
+        uint64_t when = startMs_ + tick * tickMs_;
+        // 缓存的 now 可能落后于本轮事件处理的耗时, 设置 timerfd 时读真实时钟
+        uint64_t now = fylee::GetMonotonicMS();
+        uint64_t delay_us = when > now ? (when - now) * 1000 : 100;
+        value.it_value.tv_sec = delay_us / 1000000;
+        value.it_value.tv_nsec = (delay_us % 1000000) * 1000;
+    }
+    // tick 为 0 时 it_value 全 0, 即停止 timerfd
+    if(timerfd_settime(timerfd_, 0, &value, nullptr)) {
+        LOG_ERROR(g_logger) << "TimingWheel timerfd_settime failed errno=" << errno
+            << " errstr=" << strerror(errno);
+    }
+}
+
+void TimingWheel::handleRead() {
+    loop_->assertInLoopThread();
+    uint64_t howmany;
+    if(::read(timerfd_, &howmany, sizeof(howmany)) != sizeof(howmany)) {
+        LOG_DEBUG(g_logger) << "TimingWheel::handleRead read timerfd errno=" << errno;
+    }
+    processExpired();
+}
+
+uint64_t TimingWheel::getFrontTimer() const {
+    return armedTick_ ? startMs_ + armedTick_ * tickMs_ : ~0ull;
+}
+
+void TimingWheel::processExpired() {
+    loop_->assertInLoopThread();
+    std::vector<Timer::ptr> expired;
+    uint64_t now_ms = loop_->now();
+    advance(now_ms, expired);
+
+    // 先把循环定时器放回去, 回调里再取消也能生效
+    for(auto& timer : expired) {
+        if(timer->recurring_) {
+            timer->next_ = now_ms + timer->ms_;
+            timer->wheelExpire_ = toExpireTick(timer->next_);
+            timer->wheelSelf_ = timer;
+            link(timer.get());
+        }
+    }
+    for(auto& timer : expired) {
+        // 前面的回调可能取消或重设了它
+        if(timer->deleted_ || !timer->func_
+                || (!timer->recurring_ && timer->wheelSlot_)) {
+            continue;
+        }
+        {
+            Functor func = timer->func_;
+            func();
+        }
+    }
+    schedule();
+}
+
+}
@@ -0,0 +1,124 @@
+#ifndef __FYLEE_TIMING_WHEEL_H__
+#define __FYLEE_TIMING_WHEEL_H__
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include "timer.h"
+#include "noncopyable.h"
+
+namespace fylee {
+class EventLoop;
+class Channel;
+
+/**
+ * @brief 分层时间轮
+ * @details 4 层, 每层 256 个槽, 最低层一个槽对应一个 tick.
+ *          定时器通过 Timer 中的侵入式链表挂在槽上, 添加、取消、重设都是 O(1),
+ *          取消后立即从槽上摘除. 高层的槽在低层转完一圈时逐级下放(cascade).
+ *          只在下一个有定时器的 tick 或下一次下放时才设置 timerfd, 空闲时不会空转;
+ *          添加的定时器早于已设置的 tick 时只做标记, 由 EventLoop 在 poll 之前调用
+ *          rearm(), 与 TimerQueue 一样每轮最多一次 timerfd_settime;
+ *          不使用 timerfd 时由 EventLoop 按 getFrontTimer() 计算 poll 的超时时间.
+ *          除 addTimer/cancelTimer/restartTimer 外只能在所属 loop 线程调用
+ */
+class TimingWheel : Noncopyable {
+public:
+    typedef std::function<void()> Functor;
+
+    /**
+     * @brief 构造函数, 需在 loop 线程调用
+     * @param[in] loop 所属 EventLoop
+     * @param[in] tickMs 一个 tick 的毫秒数, 也是定时精度
+     * @param[in] useTimerfd 是否使用 timerfd 唤醒 loop
+     */
+    TimingWheel(EventLoop* loop, uint64_t tickMs, bool useTimerfd = true);
+
+    ~TimingWheel();
+
+    /**
+     * @brief 添加定时器, 可在任意线程调用
+     */
+    Timer::ptr addTimer(uint64_t ms, Functor func, bool recurring = false);
+
+    /**
+     * @brief 取消定时器, 立即从时间轮上摘除
+     */
+    void cancelTimer(Timer::ptr timer);
+
+    /**
+     * @brief 把定时器重新设为 ms 毫秒后到期, 已触发的一次性定时器也可以重设
+     * @details 只是把节点换到另一个槽, 不分配内存; 已取消的定时器不能重设
+     */
+    void restartTimer(Timer::ptr timer, uint64_t ms);
+
+    /**
+     * @brief 时间轮中的定时器个数, 只能在 loop 线程调用
+     */
+    size_t size() const { return count_; }
+
+    uint64_t getTickMs() const { return tickMs_; }
+
+    /**
+     * @brief 下一个需要处理的 tick 对应的时间(单调时钟毫秒), 没有定时器时返回 ~0ull
+     */
+    uint64_t getFrontTimer() const;
+
+    /**
+     * @brief 本轮添加了更早到期的定时器时重新设置 timerfd 和 getFrontTimer(), 需在 loop 线程调用
+     */
+    void rearm();
+
+    /**
+     * @brief 推进到当前时间并执行到期的定时器, 需在 loop 线程调用
+     */
+    void processExpired();
+private:
+    static const int kLevels = 4;
+    static const int kSlotBits = 8;
+    static const int kSlots = 1 << kSlotBits;
+    static const uint64_t kSlotMask = kSlots - 1;
+
+    void addTimerInLoop(Timer::ptr timer);
+    void cancelInLoop(Timer::ptr timer);
+    void restartInLoop(Timer::ptr timer, uint64_t ms);
+
+    /// 按 wheelExpire_ 挂到对应的槽上
+    void link(Timer* timer);
+    void unlink(Timer* timer);
+    /// 把 level 层当前槽上的定时器重新分配到下层
+    void cascade(int level);
+    /// 推进到 now_ms 对应的 tick, 到期的定时器放入 expired
+    void advance(uint64_t now_ms, std::vector<Timer::ptr>& expired);
+    /// 下一个需要处理的 tick, 没有定时器时返回 0
+    uint64_t nextTick() const;
+    /// 按 nextTick() 设置 timerfd, 不使用 timerfd 时只记录 armedTick_
+    void schedule();
+    void handleRead();
+
+    uint64_t toTick(uint64_t ms) const { return (ms - startMs_) / tickMs_; }
+    uint64_t toExpireTick(uint64_t ms) const;
+
+    EventLoop* loop_;
+    uint64_t tickMs_;
+    uint64_t startMs_;
+    // 已经处理到的 tick
+    uint64_t currentTick_;
+    // 下一个需要处理的 tick, 0 表示没有
+    uint64_t armedTick_;
+    // 添加了早于 armedTick_ 的定时器, 等待 rearm()
+    bool rearmPending_;
+    size_t count_;
+    // 每层的定时器个数
+    size_t levelCount_[kLevels];
+    Timer* slots_[kLevels][kSlots];
+    // 最低层槽位是否非空的位图, 用于快速找到下一个到期的槽
+    uint64_t bitmap_[kSlots / 64];
+    const int timerfd_;
+    std::unique_ptr<Channel> timerfdChannel_;
+};
+
+}
+
+#endif
@@ -0,0 +1,600 @@
+#include "uring_poller.h"
+#include "macro.h"
+#include "channel.h"
+#include "config.h"
+#include "log.h"
+#include "buffer.h"
+#include <algorithm>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace fylee {
+static fylee::Logger::ptr g_logger = LOG_NAME("system");
+
+static fylee::ConfigVar<uint32_t>::ptr g_eventloop_io_uring_entries =
+    fylee::Config::Lookup("eventloop.io_uring.entries", (uint32_t)1024,
+                "io_uring submission queue entries per loop");
+
+static fylee::ConfigVar<uint32_t>::ptr g_eventloop_io_uring_recv_buffers =
+    fylee::Config::Lookup("eventloop.io_uring.recv_buffers", (uint32_t)1024,
+                "provided buffers per loop for completion mode recv, rounded up to a power of 2");
+
+static fylee::ConfigVar<uint32_t>::ptr g_eventloop_io_uring_recv_buffer_size =
+    fylee::Config::Lookup("eventloop.io_uring.recv_buffer_size", (uint32_t)4096,
+                "size of each provided buffer for completion mode recv");
+
+// RECV 请求的 user_data 低 32 位带此标记, 高 32 位为 (owner << 16 | req)
+static const uint32_t kRecvTag = 1u << 31;
+static const uint16_t kBufGroup = 0;
+static const uint32_t kMaxRecvBuffers = 32768;
+
+static uint64_t RecvUserData(int fd, uint16_t owner, uint16_t req) {
+    return (static_cast<uint64_t>(owner) << 48) | (static_cast<uint64_t>(req) << 32)
+        | kRecvTag | static_cast<uint32_t>(fd);
+}
+
+UringPoller::UringPoller(EventLoop* loop)
+    :Poller(loop),
+     ringFd_(-1),
+     sqRing_(MAP_FAILED),
+     sqRingSize_(0),
+     cqRing_(MAP_FAILED),
+     cqRingSize_(0),
+     sqes_(nullptr),
+     sqesSize_(0),
+     sqHead_(nullptr),
+     sqTail_(nullptr),
+     sqArray_(nullptr),
+     sqMask_(0),
+     sqEntries_(0),
+     sqeTail_(0),
+     cqHead_(nullptr),
+     cqTail_(nullptr),
+     cqMask_(0),
+     cqes_(nullptr),
+     multishot_(true),
+     nextGen_(1),
+     round_(0),
+     recvTried_(false),
+     recvMultishot_(true),
+     bufRing_(nullptr),
+     bufRingSize_(0),
+     bufBase_(nullptr),
+     bufBaseSize_(0),
+     bufEntries_(0),
+     bufSize_(0),
+     bufTail_(0),
+     recycled_(false) {
+    if (!setup(g_eventloop_io_uring_entries->getValue())) {
+        release();
+    }
+}
+
+UringPoller::~UringPoller() {
+    release();
+}
+
+bool UringPoller::setup(uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd_ < 0) {
+        LOG_WARN(g_logger) << "io_uring_setup failed errno=" << errno
+            << " errstr=" << strerror(errno);
+        return false;
+    }
+    // 需要 EXT_ARG 在等待时带超时, NODROP 保证完成队列满时不丢事件
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        LOG_WARN(g_logger) << "io_uring lacks required features=" << params.features;
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        LOG_WARN(g_logger) << "io_uring mmap sq ring failed errno=" << errno;
+        return false;
+    }
+    if (single) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            LOG_WARN(g_logger) << "io_uring mmap cq ring failed errno=" << errno;
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_WARN(g_logger) << "io_uring mmap sqes failed errno=" << errno;
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqeTail_ = *sqTail_;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    LOG_INFO(g_logger) << "io_uring poller sq_entries=" << params.sq_entries
+        << " cq_entries=" << params.cq_entries;
+    return true;
+}
+
+void UringPoller::release() {
+    if (sqes_) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if (sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    if (ringFd_ >= 0) {
+        ::close(ringFd_);
+        ringFd_ = -1;
+    }
+    // 缓冲区环随 ring 一起注销, 关闭之后才能释放内存
+    if (bufRing_) {
+        munmap(bufRing_, bufRingSize_);
+        bufRing_ = nullptr;
+    }
+    if (bufBase_) {
+        munmap(bufBase_, bufBaseSize_);
+        bufBase_ = nullptr;
+    }
+}
+
+bool UringPoller::setupCompletionRecv() {
+    if (recvTried_) {
+        return bufRing_ != nullptr;
+    }
+    recvTried_ = true;
+    uint32_t want = std::min(g_eventloop_io_uring_recv_buffers->getValue(), kMaxRecvBuffers);
+    uint32_t entries = 1;
+    while (entries < want) {
+        entries <<= 1;
+    }
+    uint32_t size = g_eventloop_io_uring_recv_buffer_size->getValue();
+    bufSize_ = size ? size : 4096;
+    bufRingSize_ = entries * sizeof(struct io_uring_buf);
+    bufBaseSize_ = static_cast<size_t>(entries) * bufSize_;
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* base = mmap(nullptr, bufBaseSize_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = kBufGroup;
+    if (ring == MAP_FAILED || base == MAP_FAILED
+            || syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        LOG_WARN(g_logger) << "io_uring provided buffer ring unavailable errno=" << errno
+            << " errstr=" << strerror(errno) << ", use readiness recv";
+        if (ring != MAP_FAILED) {
+            munmap(ring, bufRingSize_);
+        }
+        if (base != MAP_FAILED) {
+            munmap(base, bufBaseSize_);
+        }
+        return false;
+    }
+    bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+    bufBase_ = static_cast<char*>(base);
+    bufEntries_ = entries;
+    for (uint32_t i = 0; i < entries; ++i) {
+        recycleBuffer(i);
+    }
+    LOG_INFO(g_logger) << "io_uring recv buffer ring entries=" << entries
+        << " size=" << bufSize_;
+    return true;
+}
+
+void UringPoller::recycleBuffer(uint16_t bid) {
+    // 环就是 io_uring_buf 数组, tail 与第 0 项的 resv 重叠. C++ 中头文件的 bufs
+    // 柔性数组前有空结构体占位, 偏移不为 0, 不能直接用
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(bufRing_)
+        + (bufTail_ & (bufEntries_ - 1));
+    buf->addr = reinterpret_cast<uintptr_t>(bufBase_ + static_cast<size_t>(bid) * bufSize_);
+    buf->len = bufSize_;
+    buf->bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    recycled_ = true;
+}
+
+struct io_uring_sqe* UringPoller::getSqe() {
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+        // 提交队列满, 先交给内核腾出位置
+        enter(0, 0);
+        if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+            return nullptr;
+        }
+    }
+    unsigned idx = sqeTail_ & sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    ++sqeTail_;
+    return sqe;
+}
+
+int UringPoller::enter(unsigned waitNr, int timeoutMs) {
+    unsigned submit = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    struct __kernel_timespec ts;
+    if (timeoutMs > 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        arg.ts = reinterpret_cast<uintptr_t>(&ts);
+    }
+    arg.sigmask_sz = _NSIG / 8;
+    // 不等待时也带上 GETEVENTS, 让内核把溢出的完成事件搬回完成队列
+    unsigned flags = IORING_ENTER_EXT_ARG | IORING_ENTER_GETEVENTS;
+    return syscall(__NR_io_uring_enter, ringFd_, submit, waitNr, flags, &arg, sizeof(arg));
+}
+
+void UringPoller::armPoll(Channel* channel, int events) {
+    size_t fd = channel->getFd();
+    if (fd >= pollGen_.size()) {
+        pollGen_.resize(std::max(pollGen_.size() * 2, fd + 1), 0);
+    }
+    struct io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        LOG_WARN(g_logger) << "io_uring submission queue full, retry poll fd=" << fd;
+        pollGen_[fd] = 0;
+        retryArms_.push_back(fd);
+        return;
+    }
+    uint32_t gen = nextGen_++;
+    if (nextGen_ == 0) {
+        nextGen_ = 1;
+    }
+    pollGen_[fd] = gen;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = multishot_ ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = (static_cast<uint64_t>(gen) << 32) | fd;
+}
+
+void UringPoller::cancelPoll(int fd) {
+    if (static_cast<size_t>(fd) >= pollGen_.size() || !pollGen_[fd]) {
+        return;
+    }
+    submitCancel(IORING_OP_POLL_REMOVE, (static_cast<uint64_t>(pollGen_[fd]) << 32) | fd);
+    pollGen_[fd] = 0;
+}
+
+void UringPoller::submitCancel(uint8_t opcode, uint64_t target) {
+    struct io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        // 旧请求的完成事件按代号/序号丢弃, 但请求本身要取消掉, 否则一直占着 fd
+        LOG_WARN(g_logger) << "io_uring submission queue full, retry cancel fd="
+            << (static_cast<uint32_t>(target) & ~kRecvTag);
+        retryCancels_.push_back(std::make_pair(opcode, target));
+        return;
+    }
+    sqe->opcode = opcode;
+    sqe->fd = -1;
+    sqe->addr = target;
+    // 代号 0, 完成事件直接丢弃
+    sqe->user_data = 0;
+}
+
+UringPoller::RecvState& UringPoller::recvState(int fd) {
+    if (static_cast<size_t>(fd) >= recvStates_.size()) {
+        recvStates_.resize(std::max(recvStates_.size() * 2, static_cast<size_t>(fd) + 1));
+    }
+    return recvStates_[fd];
+}
+
+void UringPoller::armRecv(int fd) {
+    RecvState& state = recvState(fd);
+    struct io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        LOG_WARN(g_logger) << "io_uring submission queue full, retry recv fd=" << fd;
+        retryArms_.push_back(fd);
+        return;
+    }
+    if (++state.req == 0) {
+        state.req = 1;
+    }
+    state.armed = true;
+    state.starved = false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufGroup;
+    sqe->ioprio = recvMultishot_ ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = RecvUserData(fd, state.owner, state.req);
+}
+
+void UringPoller::cancelRecv(int fd) {
+    RecvState& state = recvState(fd);
+    state.starved = false;
+    if (!state.armed) {
+        return;
+    }
+    submitCancel(IORING_OP_ASYNC_CANCEL, RecvUserData(fd, state.owner, state.req));
+    // 已在途的数据仍按 owner 交给 Channel, 不会丢失
+    state.armed = false;
+}
+
+void UringPoller::rearmStarved() {
+    std::vector<int> starved;
+    starved.swap(starved_);
+    for (int fd : starved) {
+        Channel* channel = findChannel(fd);
+        if (recvStates_[fd].starved && channel
+                && (channel->getRegisteredEvents() & EPOLLIN)) {
+            armRecv(fd);
+        }
+    }
+}
+
+void UringPoller::retrySubmit() {
+    std::vector<std::pair<uint8_t, uint64_t> > cancels;
+    cancels.swap(retryCancels_);
+    for (auto& item : cancels) {
+        submitCancel(item.first, item.second);
+    }
+    std::vector<int> fds;
+    fds.swap(retryArms_);
+    for (int fd : fds) {
+        // Channel 可能已经移除、改了关注的事件或已重新提交, 按当前状态补齐
+        Channel* channel = findChannel(fd);
+        if (!channel) {
+            continue;
+        }
+        int events = pollEvents(channel, channel->getRegisteredEvents());
+        if (events && (static_cast<size_t>(fd) >= pollGen_.size() || !pollGen_[fd])) {
+            armPoll(channel, events);
+        }
+        if (channel->isCompletionRecv() && (channel->getRegisteredEvents() & EPOLLIN)
+                && !recvState(fd).armed) {
+            armRecv(fd);
+        }
+    }
+}
+
+int UringPoller::pollEvents(Channel* channel, int events) const {
+    if (channel->isCompletionRecv()) {
+        events &= ~EPOLLIN;
+    }
+    return (events & ~EPOLLET) ? events : 0;
+}
+
+void UringPoller::update(int operation, Channel* channel) {
+    int fd = channel->getFd();
+    int events = operation == EPOLL_CTL_DEL ? 0 : channel->getEvents();
+    int pevents = pollEvents(channel, events);
+    cancelPoll(fd);
+    if (pevents) {
+        armPoll(channel, pevents);
+    }
+    if (channel->isCompletionRecv()) {
+        if (!(events & EPOLLIN)) {
+            cancelRecv(fd);
+        } else if (!recvState(fd).armed) {
+            armRecv(fd);
+        }
+    }
+}
+
+void UringPoller::onRemove(Channel* channel) {
+    int fd = channel->getFd();
+    if (static_cast<size_t>(fd) >= recvStates_.size()) {
+        return;
+    }
+    cancelRecv(fd);
+    RecvState& state = recvStates_[fd];
+    for (auto& item : state.pending) {
+        if (item.first > 0) {
+            recycleBuffer(item.second);
+        }
+    }
+    std::vector<std::pair<int, uint16_t> >().swap(state.pending);
+    ++state.owner;
+}
+
+int UringPoller::takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf) {
+    int fd = channel->getFd();
+    if (static_cast<size_t>(fd) >= recvStates_.size() || recvStates_[fd].pending.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    RecvState& state = recvStates_[fd];
+    int total = 0;
+    size_t i = 0;
+    for (; i < state.pending.size() && state.pending[i].first > 0; ++i) {
+        uint16_t bid = state.pending[i].second;
+        buf->write(bufBase_ + static_cast<size_t>(bid) * bufSize_, state.pending[i].first);
+        recycleBuffer(bid);
+        total += state.pending[i].first;
+    }
+    if (i == 0) {
+        // 数据之后的关闭或错误, 下一次调用再返回
+        int res = state.pending[0].first;
+        state.pending.erase(state.pending.begin());
+        if (res == 0) {
+            return 0;
+        }
+        errno = -res;
+        return -1;
+    }
+    state.pending.erase(state.pending.begin(), state.pending.begin() + i);
+    return total;
+}
+
+uint64_t UringPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+    ++round_;
+    if (!retryCancels_.empty() || !retryArms_.empty()) {
+        retrySubmit();
+    }
+    if (!starved_.empty() && recycled_) {
+        rearmStarved();
+    }
+    if (!retryCancels_.empty() || !retryArms_.empty()) {
+        // 仍有请求没能提交, 不阻塞等待, 提交后马上再试
+        timeoutMs = 0;
+    }
+    int ret = enter(timeoutMs == 0 ? 0 : 1, timeoutMs);
+    int savedErrno = errno;
+    uint64_t now_ms = fylee::GetMonotonicMS();
+    if (ret < 0 && savedErrno != ETIME && savedErrno != EINTR && savedErrno != EBUSY) {
+        LOG_ERROR(g_logger) << "UringPoller::poll() io_uring_enter errno=" << savedErrno
+            << " errstr=" << strerror(savedErrno);
+    }
+    int numEvents = reapCompletions(activeChannels);
+    LOG_DEBUG(g_logger) << numEvents << " events happened";
+    return now_ms;
+}
+
+int UringPoller::reapCompletions(ChannelList* activeChannels) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    int numEvents = 0;
+    for (; head != tail; ++head) {
+        struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        if (static_cast<uint32_t>(cqe->user_data) & kRecvTag) {
+            reapRecv(cqe, activeChannels, &numEvents);
+            continue;
+        }
+        uint32_t gen = cqe->user_data >> 32;
+        size_t fd = static_cast<uint32_t>(cqe->user_data);
+        int res = cqe->res;
+        // POLL_REMOVE 的结果, 或已被取消、替换的旧请求
+        if (!gen || fd >= pollGen_.size() || pollGen_[fd] != gen) {
+            continue;
+        }
+        Channel* channel = findChannel(fd);
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            // 请求已结束, 还关注事件时重新提交
+            pollGen_[fd] = 0;
+            if (res == -EINVAL && multishot_) {
+                LOG_WARN(g_logger) << "io_uring multishot poll unsupported, use oneshot poll";
+                multishot_ = false;
+            }
+            int events = channel ? pollEvents(channel, channel->getRegisteredEvents()) : 0;
+            if (events) {
+                armPoll(channel, events);
+            }
+        }
+        if (res < 0) {
+            if (res != -ECANCELED && res != -EINVAL) {
+                LOG_ERROR(g_logger) << "io_uring poll fd=" << fd << " failed errno=" << -res
+                    << " errstr=" << strerror(-res);
+            }
+            continue;
+        }
+        if (!channel) {
+            continue;
+        }
+        if (channel->isCompletionRecv() && (res & EPOLLHUP)) {
+            // 挂断交给读回调, 由 RECV 返回的关闭或错误处理, 先把已收到的数据交上去
+            res |= EPOLLIN;
+        }
+        if (activate(channel, res, activeChannels)) {
+            ++numEvents;
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return numEvents;
+}
+
+void UringPoller::reapRecv(struct io_uring_cqe* cqe, ChannelList* activeChannels, int* numEvents) {
+    int fd = static_cast<uint32_t>(cqe->user_data) & ~kRecvTag;
+    uint16_t owner = cqe->user_data >> 48;
+    uint16_t req = cqe->user_data >> 32;
+    int res = cqe->res;
+    bool hasBuffer = cqe->flags & IORING_CQE_F_BUFFER;
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    Channel* channel = findChannel(fd);
+    RecvState& state = recvState(fd);
+    if (owner != state.owner || !channel) {
+        // Channel 已经移除, fd 可能已被复用, 数据丢弃
+        if (hasBuffer) {
+            recycleBuffer(bid);
+        }
+        return;
+    }
+    bool retry = false;
+    if (!(cqe->flags & IORING_CQE_F_MORE) && state.armed && req == state.req) {
+        // 当前请求已结束
+        state.armed = false;
+        if (res == -ENOBUFS) {
+            state.starved = true;
+            starved_.push_back(fd);
+            recycled_ = false;
+            retry = true;
+        } else if (res == -EINVAL && recvMultishot_) {
+            LOG_WARN(g_logger) << "io_uring multishot recv unsupported, use oneshot recv";
+            recvMultishot_ = false;
+            retry = true;
+            armRecv(fd);
+        } else if (res > 0 && (channel->getRegisteredEvents() & EPOLLIN)) {
+            // 单次 recv, 或被内核提前结束的 multishot, 继续接收
+            armRecv(fd);
+        }
+    }
+    if (retry || res == -ENOBUFS || res == -ECANCELED) {
+        return;
+    }
+    if (res > 0 && !hasBuffer) {
+        LOG_ERROR(g_logger) << "io_uring recv fd=" << fd << " completed without buffer";
+        return;
+    }
+    if (res <= 0 && hasBuffer) {
+        recycleBuffer(bid);
+    }
+    state.pending.push_back(std::make_pair(res, bid));
+    if (activate(channel, EPOLLIN, activeChannels)) {
+        ++*numEvents;
+    }
+}
+
+bool UringPoller::activate(Channel* channel, int revents, ChannelList* activeChannels) {
+    size_t fd = channel->getFd();
+    if (fd >= activeRound_.size()) {
+        activeRound_.resize(std::max(activeRound_.size() * 2, fd + 1), 0);
+    }
+    // 同一个 fd 在一轮中可能有多个完成事件, 合并成一次回调
+    if (activeRound_[fd] == round_) {
+        channel->setRevents(channel->getRevents() | revents);
+        return false;
+    }
+    activeRound_[fd] = round_;
+    channel->setRevents(revents);
+    activeChannels->push_back(channel);
+    return true;
+}
+}
@@ -0,0 +1,152 @@
+#ifndef __FYLEE_URING_POLLER_H_
+#define __FYLEE_URING_POLLER_H_
+#include <stdint.h>
+#include <vector>
+#include "poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace fylee {
+
+/**
+ * @brief io_uring 后端, 直接使用系统调用, 不依赖 liburing
+ * @details 每个 Channel 对应一个 multishot POLL_ADD 请求, 关注事件变化时先 POLL_REMOVE
+ *          旧请求再提交新请求. 所有请求只写入提交队列, 在 poll() 里与等待合并为一次
+ *          io_uring_enter, 一轮中的多次变化只需一次系统调用.
+ *          请求的 user_data 为 (代号 << 32 | fd), 每次提交换一个代号, 旧请求迟到的完成事件
+ *          按代号丢弃, fd 被复用也不会误投. 内核不支持 multishot 时完成事件不带
+ *          IORING_CQE_F_MORE, 此时重新提交, 退化为单次 poll.
+ *          需要 5.11 以上内核(IORING_FEAT_EXT_ARG), 不满足时 isValid() 为 false.
+ *
+ *          完成模式接收: Channel::isCompletionRecv() 的读事件不再 poll, 改为提交 multishot
+ *          RECV, 由内核从每个 loop 一个的缓冲区环(provided buffer ring)中挑选缓冲区,
+ *          空闲连接不占接收内存. 收到的数据先挂在 fd 上, Channel 以 EPOLLIN 出现在活跃列表中,
+ *          由 takeReceived 拷贝进连接的 Buffer 并立即归还缓冲区. 暂停读取只取消请求,
+ *          已收到的数据保留; 缓冲区耗尽的请求在有缓冲区归还后重新提交
+ */
+class UringPoller : public Poller {
+public:
+    UringPoller(EventLoop* loop);
+    ~UringPoller();
+
+    /**
+     * @brief 内核是否支持, 不支持时应改用 EPollPoller
+     */
+    bool isValid() const { return ringFd_ >= 0; }
+
+    uint64_t poll(int timeoutMs, ChannelList* activeChannels) override;
+
+    const char* getName() const override { return "io_uring"; }
+
+    /**
+     * @brief 首次调用时注册缓冲区环, 大小取自 eventloop.io_uring.recv_buffers
+     *        和 eventloop.io_uring.recv_buffer_size, 内核不支持(5.19 以下)时返回 false
+     */
+    bool setupCompletionRecv() override;
+
+    int takeReceived(Channel* channel, const std::shared_ptr<Buffer>& buf) override;
+
+protected:
+    void update(int operation, Channel* channel) override;
+
+    void onRemove(Channel* channel) override;
+
+private:
+    bool setup(uint32_t entries);
+    void release();
+    /// 取一个空闲的提交项, 提交队列满时先提交
+    io_uring_sqe* getSqe();
+    /// 提交已写入的请求, 并等待至少 waitNr 个完成事件
+    int enter(unsigned waitNr, int timeoutMs);
+    /// 为 channel 提交关注 events 的 poll 请求
+    void armPoll(Channel* channel, int events);
+    /// 取消 fd 上当前的 poll 请求
+    void cancelPoll(int fd);
+    /// 提交取消 target 请求的 opcode 请求, 提交队列满时放入重试列表
+    void submitCancel(uint8_t opcode, uint64_t target);
+    /// 重新提交上次因提交队列满而没能提交的请求
+    void retrySubmit();
+    /// 处理完成队列, 返回处理的事件个数
+    int reapCompletions(ChannelList* activeChannels);
+    /// 处理 RECV 请求的完成事件
+    void reapRecv(io_uring_cqe* cqe, ChannelList* activeChannels, int* numEvents);
+    /// 把 channel 放入本轮的活跃列表, 同一轮中多次出现时合并 revents
+    bool activate(Channel* channel, int revents, ChannelList* activeChannels);
+    /// channel 需要 poll 的事件, 完成模式下不含 EPOLLIN; 没有时返回 0
+    int pollEvents(Channel* channel, int events) const;
+
+    /// fd 上完成模式接收的状态
+    struct RecvState {
+        /// 每次 Channel 移除后加一, 之前请求的完成事件全部丢弃
+        uint16_t owner = 0;
+        /// 当前 RECV 请求的序号
+        uint16_t req = 0;
+        /// 有进行中的 RECV 请求
+        bool armed = false;
+        /// 因缓冲区耗尽而结束, 等待有缓冲区归还后重新提交
+        bool starved = false;
+        /// 已收到未取走的结果: res > 0 为缓冲区 bid 中的字节数, 0 为对端关闭, < 0 为错误
+        std::vector<std::pair<int, uint16_t> > pending;
+    };
+    RecvState& recvState(int fd);
+    void armRecv(int fd);
+    void cancelRecv(int fd);
+    /// 把缓冲区放回环中
+    void recycleBuffer(uint16_t bid);
+    /// 缓冲区归还后重新提交耗尽的 RECV 请求
+    void rearmStarved();
+
+    int ringFd_;
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqArray_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    // 本地写入位置, enter 时才同步给内核
+    unsigned sqeTail_;
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+    // 内核是否支持 multishot poll, 不支持时每次完成后重新提交
+    bool multishot_;
+
+    // 每个 fd 当前 poll 请求的代号, 0 表示没有
+    std::vector<uint32_t> pollGen_;
+    uint32_t nextGen_;
+    // 每个 fd 最近一次出现在活跃列表中的轮次, 用于合并同一轮的多个完成事件
+    std::vector<uint64_t> activeRound_;
+    uint64_t round_;
+
+    // 完成模式接收
+    bool recvTried_;
+    bool recvMultishot_;
+    io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufBase_;
+    size_t bufBaseSize_;
+    uint32_t bufEntries_;
+    uint32_t bufSize_;
+    // 本地的缓冲区环尾部, 归还时推进
+    uint16_t bufTail_;
+    std::vector<RecvState> recvStates_;
+    // 等待缓冲区的 fd, 以及上次耗尽之后是否有缓冲区归还
+    std::vector<int> starved_;
+    bool recycled_;
+    // 提交队列满而没能提交的取消请求(opcode, 要取消的 user_data), 和要按 Channel
+    // 当前关注的事件重新提交 poll/RECV 的 fd, 在下一次 poll 开始时重试
+    std::vector<std::pair<uint8_t, uint64_t> > retryCancels_;
+    std::vector<int> retryArms_;
+};
+}
+#endif
@@ -83,6 +83,28 @@ uint64_t GetCurrentUS() {
     return tv.tv_sec * 1000 * 1000ul  + tv.tv_usec;
 }
 
+uint64_t GetMonotonicMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+uint64_t GetMonotonicUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+static thread_local time_t t_cached_time = 0;
+
+time_t GetCachedTime() {
+    return t_cached_time ? t_cached_time : time(0);
+}
+
+void SetCachedTime(time_t v) {
+    t_cached_time = v;
+}
+
 std::string Time2Str(time_t ts, const std::string& format) {
     struct tm tm;
     localtime_r(&ts, &tm);
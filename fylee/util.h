@@ -213,6 +213,23 @@ public:
 
 uint64_t GetCurrentMS();
 uint64_t GetCurrentUS();
+
+/**
+ * @brief 单调时钟(CLOCK_MONOTONIC), 不受 NTP 等调整系统时间的影响, 用于定时器和超时
+ */
+uint64_t GetMonotonicMS();
+uint64_t GetMonotonicUS();
+
+/**
+ * @brief 当前线程缓存的墙上时间(秒), 用于日志时间戳
+ * @details 运行 EventLoop 的线程每轮循环刷新一次, 没有缓存的线程直接调用 time(0)
+ */
+time_t GetCachedTime();
+
+/**
+ * @brief 设置当前线程缓存的墙上时间, 0 表示不再使用缓存
+ */
+void SetCachedTime(time_t v);
 std::string Time2Str(time_t ts, const std::string& format);
 std::string GetHostName();
 std::string GetIPv4();